@@ -17,37 +17,1345 @@
 #include <ap_int.h>
 #include <hlslib/xilinx/Stream.h>
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <fstream>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <regex>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <thread>
+#include <unistd.h>
+#include <vector>
 #include <zmq.hpp>
 
 typedef ap_axiu<512, 0, 0, 0> data_stream_t;
 
 const int RECV_POLL_INTERVAL = 100;
 
-class AuroraEmu {
+// maximum time in us a shared memory link sleeps while waiting for data
+const int SHM_MAX_BACKOFF = 50;
+
+// interval in ms in which a routed switch retries to deliver queued messages
+const int ROUTE_RETRY_INTERVAL = 1;
+
+// default number of flits a routed switch queues per core
+const unsigned int DEFAULT_MAX_QUEUED_FLITS = 4096;
+
+// default maximum number of flits coalesced into a single message
+const unsigned int DEFAULT_BATCH_SIZE = 64;
+
+// default interval in microseconds in which the threads of a core check
+// user streams that were accessed without notify()
+const unsigned int DEFAULT_USER_POLL_INTERVAL = 1000;
+
+// remaining wait in microseconds below which the paced send thread and
+// the delayed delivery yield instead of sleeping, because sleeping
+// overshoots by tens of microseconds
+const int PACING_SPIN_INTERVAL = 50;
+
+/**
+ * Disable the high water marks of a data socket. PUB sockets silently drop
+ * messages when the high water mark is reached, but the emulated link has
+ * to be lossless like the real one.
+ */
+inline void set_lossless(zmq::socket_t &socket) {
+    socket.set(zmq::sockopt::sndhwm, 0);
+    socket.set(zmq::sockopt::rcvhwm, 0);
+}
+
+// number of lanes of the emulated Aurora core
+const unsigned int AURORA_LANES = 4;
+// line rate of a single lane in bits per second
+const double AURORA_LANE_RATE = 25.78125e9;
+// bytes per 64B/66B block
+const unsigned int AURORA_BLOCK_BYTES = 8;
+// bits on the line per 64B/66B block
+const unsigned int AURORA_BLOCK_LINE_BITS = 66;
+// default line bytes per frame that are spent on the separator block and
+// the CRC in framing mode
+const unsigned int DEFAULT_FRAME_OVERHEAD_BYTES =
+    2 * AURORA_LANES * AURORA_BLOCK_BYTES;
+
+// default RX FIFO configuration as generated by the Makefile for a FIFO
+// width of 64 bytes
+const unsigned int DEFAULT_RX_FIFO_DEPTH = 1024;
+const unsigned int DEFAULT_RX_FIFO_PROG_FULL = DEFAULT_RX_FIFO_DEPTH / 2;
+const unsigned int DEFAULT_RX_FIFO_PROG_EMPTY = DEFAULT_RX_FIFO_DEPTH / 8;
+
+/**
+ * Configuration of an emulated Aurora core.
+ */
+struct AuroraEmuConfig {
+    // maximum number of flits coalesced into a single message. A message
+    // is sent as soon as the TX stream runs empty or a flit with TLAST set
+    // is read, so this only has an effect for bursts.
+    unsigned int batch_size = DEFAULT_BATCH_SIZE;
+    // interval in microseconds in which the send thread checks an empty TX
+    // stream and the drain thread a full RX stream. hlslib::Stream has no
+    // hook to wake them up, so writers that do not call notify() are only
+    // noticed after this interval
+    unsigned int user_poll_interval = DEFAULT_USER_POLL_INTERVAL;
+    // model the cost of the Aurora framing interface (USE_FRAMING=1)
+    bool framing = false;
+    // line bytes that are spent per frame if framing is modeled
+    unsigned int frame_overhead_bytes = DEFAULT_FRAME_OVERHEAD_BYTES;
+    // send XOFF and XON to the remote core like aurora_flow_nfc. Without
+    // NFC, the recv thread waits for the drain thread while the RX FIFO is
+    // full, so the back pressure reaches the sender through ZMQ and the
+    // switch
+    bool nfc = true;
+    // connect to a switch in routed mode (AuroraEmuSwitchConfig::routed)
+    bool routed = false;
+    // number of flits in the RX FIFO. With NFC, flits that are received
+    // while the FIFO is full are counted as overflow, but not dropped
+    unsigned int rx_fifo_depth = DEFAULT_RX_FIFO_DEPTH;
+    // XOFF is sent when the RX FIFO holds at least this many flits
+    unsigned int rx_fifo_prog_full = DEFAULT_RX_FIFO_PROG_FULL;
+    // XON is sent when the RX FIFO holds at most this many flits
+    unsigned int rx_fifo_prog_empty = DEFAULT_RX_FIFO_PROG_EMPTY;
+    // line rate of the emulated link in bit/s. The send thread is paced
+    // with a token bucket to the line bits of the transmitted data, so the
+    // framing overhead is included. AURORA_LANES * AURORA_LANE_RATE models
+    // the hardware. 0 disables pacing
+    double bandwidth = 0.0;
+    // line bits that can be sent at once after the link was idle. A batch
+    // is always sent as a whole, even if it is larger
+    uint64_t burst_bits = 0;
+    // delay in nanoseconds between sending a batch and pushing it into the
+    // RX FIFO of the receiving core
+    uint64_t latency_ns = 0;
+    // maximum random delay in nanoseconds that is added to the latency of
+    // every batch. The order of the batches is kept
+    uint64_t jitter_ns = 0;
+    // probability that a received flit gets a random bit flipped. Counted
+    // as soft error and, if framing is modeled, as frame with errors
+    double bit_flip_rate = 0.0;
+    // probability that a received flit is lost. Counted as soft error
+    double drop_rate = 0.0;
+    // every channel_down_interval received flits, the channel goes down
+    // and the next channel_down_flits flits are lost. Counted as hard
+    // error, channel down and line down of all lanes. 0 disables
+    uint64_t channel_down_interval = 0;
+    uint64_t channel_down_flits = 0;
+    // every reset_interval received flits, the core is reset and the
+    // flits in the RX FIFO are lost. Counted as channel down and line down
+    // of all lanes. 0 disables
+    uint64_t reset_interval = 0;
+    // seed of the random jitter and of the injected faults
+    uint64_t seed = 0;
+};
+
+/**
+ * Types of the messages exchanged between emulated cores
+ */
+enum AuroraEmuMessageType : uint32_t {
+    AURORA_EMU_DATA = 0,
+    AURORA_EMU_NFC_XOFF = 1,
+    AURORA_EMU_NFC_XON = 2,
+    // sent by a routed switch to a core while the queue of its destination
+    // is full and after it drained again
+    AURORA_EMU_SWITCH_HOLD = 3,
+    AURORA_EMU_SWITCH_RELEASE = 4
+};
+
+/**
+ * Header of a message on the wire. NFC messages only consist of the header,
+ * data messages are followed by
+ *
+ * - a bitmap with one bit per flit that is set if TLAST is set
+ * - a bitmap with one bit per flit that is set if not all bits of TKEEP
+ *   are set
+ * - the TKEEP values of all flits marked in the second bitmap
+ * - the data of all flits
+ *
+ * Both bitmaps are stored in 64 bit words. With the full TKEEP that is
+ * used by the issue kernel, header and sideband cost 40 bytes per batch
+ * of up to 64 flits.
+ */
+struct AuroraEmuBatchHeader {
+    uint32_t type;
+    uint32_t flits;
+    uint32_t partial_keeps;
+    uint32_t reserved;
+    // time the batch left the sender in nanoseconds of the steady clock
+    uint64_t timestamp;
+};
+
+/**
+ * Lock-free ring buffer for a single producer and a single consumer thread.
+ * The storage is allocated once on construction.
+ */
+template <typename T>
+class AuroraEmuRing {
+   private:
+    std::vector<T> buffer;
+    size_t mask;
+    // index of the next element to pop, written by the consumer
+    std::atomic<size_t> head;
+    // index of the next element to push, written by the producer
+    std::atomic<size_t> tail;
+
+   public:
+    /**
+     * capacity: minimum number of elements. Rounded up to a power of two
+     */
+    explicit AuroraEmuRing(size_t capacity) : head(0), tail(0) {
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        buffer.resize(size);
+        mask = size - 1;
+    }
+
+    // returns false if the ring is full
+    bool push(const T &value) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == buffer.size()) {
+            return false;
+        }
+        buffer[t & mask] = value;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // returns false if the ring is empty
+    bool pop(T &value) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = buffer[h & mask];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const {
+        return head.load(std::memory_order_acquire) ==
+               tail.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const { return buffer.size(); }
+};
+
+/**
+ * Single producer single consumer ring of flits in a POSIX shared memory
+ * segment. It is used by AuroraEmu for the shm:// scheme to bypass the
+ * socket stack for cores on the same host. The segment is created by the
+ * receiving core and opened by the sending core.
+ */
+class AuroraEmuShmRing {
+   private:
+    // flit with sideband as stored in the segment
+    struct Flit {
+        uint64_t data[sizeof(ap_uint<512>) / sizeof(uint64_t)];
+        uint64_t keep;
+        uint64_t last;
+    };
+
+    // head and tail on separate cache lines, followed by the flits
+    struct Header {
+        uint64_t capacity;
+        uint64_t padding0[7];
+        std::atomic<uint64_t> head;
+        uint64_t padding1[7];
+        std::atomic<uint64_t> tail;
+        uint64_t padding2[7];
+    };
+
+    std::string name;
+    bool owner;
+    size_t size;
+    Header *header;
+    Flit *flits;
+
+    static size_t segment_size(size_t capacity) {
+        return sizeof(Header) + capacity * sizeof(Flit);
+    }
+
+    void map(int fd) {
+        void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                       0);
+        close(fd);
+        if (p == MAP_FAILED) {
+            throw std::runtime_error("Could not map shared memory " + name);
+        }
+        header = static_cast<Header *>(p);
+        flits = reinterpret_cast<Flit *>(header + 1);
+    }
+
+   public:
+    AuroraEmuShmRing() : owner(false), size(0), header(nullptr), flits(nullptr) {}
+
+    AuroraEmuShmRing(const AuroraEmuShmRing &) = delete;
+    AuroraEmuShmRing &operator=(const AuroraEmuShmRing &) = delete;
+
+    /**
+     * Create the segment for the receiving core
+     *
+     * name: name of the segment. Must start with a slash
+     * capacity: number of flits in the ring
+     */
+    void create(const std::string &name, size_t capacity) {
+        this->name = name;
+        size = segment_size(capacity);
+        // remove leftovers of a crashed run
+        shm_unlink(name.c_str());
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0 || ftruncate(fd, size) != 0) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            throw std::runtime_error("Could not create shared memory " + name);
+        }
+        owner = true;
+        map(fd);
+        header->capacity = capacity;
+        header->head = 0;
+        header->tail = 0;
+    }
+
+    /**
+     * Open the segment of the receiving core for sending
+     *
+     * name: name of the segment. Must start with a slash
+     */
+    void open(const std::string &name) {
+        this->name = name;
+        int fd = shm_open(name.c_str(), O_RDWR, 0600);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            throw std::runtime_error("Could not open shared memory " + name);
+        }
+        size = st.st_size;
+        map(fd);
+    }
+
+    ~AuroraEmuShmRing() {
+        if (header != nullptr) {
+            munmap(header, size);
+        }
+        if (owner) {
+            shm_unlink(name.c_str());
+        }
+    }
+
+    bool is_open() const { return header != nullptr; }
+
+    // number of flits in the ring
+    size_t level() const {
+        return header->tail.load(std::memory_order_acquire) -
+               header->head.load(std::memory_order_acquire);
+    }
+
+    // returns false if the ring is full
+    bool push(const data_stream_t &value) {
+        uint64_t t = header->tail.load(std::memory_order_relaxed);
+        if (t - header->head.load(std::memory_order_acquire) ==
+            header->capacity) {
+            return false;
+        }
+        Flit &f = flits[t % header->capacity];
+        std::memcpy(f.data, &value.data, sizeof(f.data));
+        f.keep = value.keep.to_uint64();
+        f.last = value.last.to_uint64();
+        header->tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // returns false if the ring is empty
+    bool pop(data_stream_t &value) {
+        uint64_t h = header->head.load(std::memory_order_relaxed);
+        if (h == header->tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        const Flit &f = flits[h % header->capacity];
+        std::memcpy(&value.data, f.data, sizeof(f.data));
+        value.keep = f.keep;
+        value.last = f.last;
+        header->head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+/**
+ * Back off while polling a shared memory ring: spin shortly, then yield and
+ * finally sleep, so idle links do not occupy a CPU core.
+ */
+class AuroraEmuBackoff {
+   private:
+    unsigned int attempts = 0;
+
+   public:
+    void wait() {
+        if (attempts < 64) {
+            attempts++;
+        } else if (attempts < 128) {
+            attempts++;
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(
+                std::chrono::microseconds(SHM_MAX_BACKOFF));
+        }
+    }
+
+    void reset() { attempts = 0; }
+};
+
+/**
+ * Common functionality of the emulated Aurora cores to pass data between
+ * the user streams and the messages sent over the network.
+ */
+class AuroraEmuEndpoint {
+   protected:
+    // streams used to pass data to and from user kernels
+    hlslib::Stream<data_stream_t> &remote_to_user;
+    hlslib::Stream<data_stream_t> &user_to_remote;
+
+    AuroraEmuConfig config;
+
+    // cleared to terminate the threads. The threads wait for the user
+    // streams on user_cv instead of blocking on them, so they notice it
+    // even if the user kernel stopped reading or writing
+    std::atomic<bool> running;
+
+    // used by the send and drain thread to sleep until notify() is called
+    // or a user stream gets ready
+    std::mutex user_mutex;
+    std::condition_variable user_cv;
+    std::atomic<int> user_waiting;
+
+    // flits of the batch that is currently assembled by the send thread
+    std::vector<data_stream_t> batch;
+
+    // encoded batch that is sent by the send thread
+    std::vector<uint64_t> wire_buffer;
+
+    // serializes the access to the outgoing socket, which is shared by
+    // the send thread and the NFC
+    std::mutex socket_mutex;
+
+    // protects tx_paused and tx_held
+    std::mutex tx_mutex;
+    std::condition_variable tx_cv;
+    // set while the remote core requested to stop sending
+    bool tx_paused;
+    // set while the routed switch requested to stop sending
+    bool tx_held;
+
+    // emulated RX FIFO that is filled by the recv thread and drained into
+    // remote_to_user by the drain thread. Flits that do not fit into the
+    // ring are appended to rx_overflow, which is protected by rx_mutex
+    AuroraEmuRing<data_stream_t> rx_ring;
+    std::deque<data_stream_t> rx_overflow;
+    std::atomic<size_t> rx_overflow_size;
+    // number of flits in ring and overflow
+    std::atomic<size_t> rx_level;
+    std::thread drain_thread;
+
+    // used by the drain thread to sleep while the RX FIFO is empty and,
+    // without NFC, by the recv thread while it is full
+    std::mutex rx_mutex;
+    std::condition_variable rx_cv;
+    std::atomic<bool> drain_waiting;
+    std::condition_variable rx_space_cv;
+    std::atomic<bool> recv_waiting;
+
+    // the state is only changed with nfc_mutex held, but read without
+    // lock to detect if a transition is possible
+    enum NfcState { NFC_IDLE, NFC_EMPTY, NFC_FULL };
+    std::mutex nfc_mutex;
+    std::atomic<NfcState> nfc_state;
+    std::atomic<uint32_t> latency_count;
+
+    // counters of the NFC with the same semantics as in aurora_flow_nfc
+    std::atomic<uint32_t> full_trigger_count;
+    std::atomic<uint32_t> empty_trigger_count;
+    std::atomic<uint32_t> max_latency;
+    std::atomic<uint32_t> fifo_rx_overflow_count;
+
+    // counters of the transmitted data and of the modeled line usage
+    std::atomic<uint64_t> tx_count;
+    std::atomic<uint64_t> rx_count;
+    std::atomic<uint64_t> frames_transmitted;
+    std::atomic<uint64_t> frames_received;
+    std::atomic<uint64_t> payload_bytes;
+    std::atomic<uint64_t> line_bits;
+
+    // time at which the link finishes sending the paced data. Only used by
+    // the send thread
+    std::chrono::steady_clock::time_point pacing_end;
+
+    // delivery time of the last batch and generator of the jitter. Only
+    // used by the recv thread
+    uint64_t last_delivery;
+    std::mt19937_64 jitter_rng;
+
+    // state of the fault injection. Only used by the recv thread
+    std::mt19937_64 fault_rng;
+    std::uniform_real_distribution<double> fault_dist;
+    uint64_t fault_position;
+    uint64_t channel_down_left;
+    bool frame_corrupted;
+    // flits the drain thread discards after a reset
+    std::atomic<size_t> rx_discard;
+
+    // counters of the injected faults with the same names as in Aurora.hpp
+    std::atomic<uint32_t> soft_err_count;
+    std::atomic<uint32_t> hard_err_count;
+    std::atomic<uint32_t> channel_down_count;
+    std::atomic<uint32_t> line_down_count;
+    std::atomic<uint32_t> frames_with_errors;
+    std::atomic<uint64_t> lost_flits;
+
+    AuroraEmuEndpoint(hlslib::Stream<data_stream_t> &user_to_remote,
+                      hlslib::Stream<data_stream_t> &remote_to_user,
+                      AuroraEmuConfig config)
+        : remote_to_user(remote_to_user),
+          user_to_remote(user_to_remote),
+          config(config),
+          running(true),
+          user_waiting(0),
+          tx_paused(false),
+          tx_held(false),
+          rx_ring(config.rx_fifo_depth),
+          rx_overflow_size(0),
+          rx_level(0),
+          drain_waiting(false),
+          recv_waiting(false),
+          nfc_state(NFC_EMPTY),
+          latency_count(0),
+          full_trigger_count(0),
+          empty_trigger_count(0),
+          max_latency(0),
+          fifo_rx_overflow_count(0),
+          tx_count(0),
+          rx_count(0),
+          frames_transmitted(0),
+          frames_received(0),
+          payload_bytes(0),
+          line_bits(0),
+          last_delivery(0),
+          jitter_rng(config.seed),
+          fault_rng(config.seed),
+          fault_dist(0.0, 1.0),
+          fault_position(0),
+          channel_down_left(0),
+          frame_corrupted(false),
+          rx_discard(0),
+          soft_err_count(0),
+          hard_err_count(0),
+          channel_down_count(0),
+          line_down_count(0),
+          frames_with_errors(0),
+          lost_flits(0) {
+        if (this->config.batch_size == 0) {
+            throw std::invalid_argument("Batch size must be at least 1");
+        }
+        if (this->config.batch_size > this->config.rx_fifo_depth) {
+            throw std::invalid_argument(
+                "Batch size must not exceed the RX FIFO depth");
+        }
+        if (this->config.bandwidth < 0.0) {
+            throw std::invalid_argument("Bandwidth must not be negative");
+        }
+        if (this->config.bit_flip_rate < 0.0 ||
+            this->config.bit_flip_rate > 1.0 || this->config.drop_rate < 0.0 ||
+            this->config.drop_rate > 1.0) {
+            throw std::invalid_argument(
+                "Fault rates must be probabilities between 0 and 1");
+        }
+        if (this->config.rx_fifo_prog_empty >= this->config.rx_fifo_prog_full ||
+            this->config.rx_fifo_prog_full > this->config.rx_fifo_depth) {
+            throw std::invalid_argument(
+                "RX FIFO thresholds must satisfy prog_empty < prog_full <= "
+                "depth");
+        }
+        batch.resize(this->config.batch_size);
+        wire_buffer.resize(wire_words(this->config.batch_size,
+                                      this->config.batch_size));
+    }
+
+    static size_t bitmap_words(size_t flits) { return (flits + 63) / 64; }
+
+    virtual ~AuroraEmuEndpoint() {}
+
+    /**
+     * Send an NFC message to the core(s) sending data to this core. Called
+     * with nfc_mutex held, so the messages leave in the order of the state
+     * changes. Must not be called with rx_mutex held, because sending may
+     * block until the remote side received data.
+     */
+    virtual void send_nfc(AuroraEmuMessageType type) = 0;
+
+    /**
+     * Build a message that only consists of a header
+     */
+    static void build_nfc(zmq::message_t &msg, AuroraEmuMessageType type) {
+        AuroraEmuBatchHeader header = {type, 0, 0, 0, 0};
+        msg.rebuild(&header, sizeof(header));
+    }
+
+    static bool is_data(const zmq::message_t &msg) {
+        AuroraEmuBatchHeader header;
+        if (msg.size() < sizeof(header)) {
+            return false;
+        }
+        std::memcpy(&header, msg.data(), sizeof(header));
+        return header.type == AURORA_EMU_DATA;
+    }
+
+    static size_t wire_words(size_t flits, size_t partial_keeps) {
+        return sizeof(AuroraEmuBatchHeader) / sizeof(uint64_t) +
+               2 * bitmap_words(flits) + partial_keeps +
+               flits * sizeof(ap_uint<512>) / sizeof(uint64_t);
+    }
+
+    static uint64_t now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    /**
+     * Block until a point in time. Sleeps for long waits and yields for
+     * the last PACING_SPIN_INTERVAL microseconds to be precise
+     */
+    static void wait_until(std::chrono::steady_clock::time_point deadline) {
+        auto spin = std::chrono::microseconds(PACING_SPIN_INTERVAL);
+        if (deadline - std::chrono::steady_clock::now() > spin) {
+            std::this_thread::sleep_until(deadline - spin);
+        }
+        while (std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::yield();
+        }
+    }
+
+    /**
+     * Limit the line bits sent per second to config.bandwidth. Token
+     * bucket in its virtual scheduling form: pacing_end advances by the
+     * transmission time of every batch and the send thread blocks while it
+     * is more than burst_bits ahead of the current time.
+     *
+     * bits: line bits of the batch that is sent next
+     */
+    void pace(uint64_t bits) {
+        if (config.bandwidth <= 0.0) {
+            return;
+        }
+        auto now = std::chrono::steady_clock::now();
+        auto to_duration = [this](uint64_t b) {
+            return std::chrono::duration_cast<
+                std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(b / config.bandwidth));
+        };
+        pacing_end = std::max(pacing_end, now) + to_duration(bits);
+        wait_until(pacing_end - to_duration(std::max(bits, config.burst_bits)));
+    }
+
+    /**
+     * Set the time the batch leaves the sender in an encoded message. Has
+     * to be called right before sending
+     */
+    static void stamp(zmq::message_t &msg) {
+        uint64_t timestamp = now_ns();
+        std::memcpy(static_cast<char *>(msg.data()) +
+                        offsetof(AuroraEmuBatchHeader, timestamp),
+                    &timestamp, sizeof(timestamp));
+    }
+
+    /**
+     * Block the recv thread until a batch has to be delivered according to
+     * the modeled latency and jitter. The timestamps of sender and
+     * receiver are only comparable if both run on the same host.
+     *
+     * timestamp: time the batch left the sender
+     */
+    void delay_delivery(uint64_t timestamp) {
+        if (config.latency_ns == 0 && config.jitter_ns == 0) {
+            return;
+        }
+        uint64_t due = (timestamp ? timestamp : now_ns()) + config.latency_ns;
+        if (config.jitter_ns > 0) {
+            due += jitter_rng() % (config.jitter_ns + 1);
+        }
+        // batches are delivered in order like on a serial link
+        due = std::max(due, last_delivery);
+        last_delivery = due;
+        wait_until(std::chrono::steady_clock::time_point(
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::nanoseconds(due))));
+    }
+
+    /**
+     * Number of flits in the RX FIFO that are lost by an injected reset
+     */
+    virtual size_t rx_fifo_level() { return rx_level; }
+
+    bool faults_enabled() {
+        return config.bit_flip_rate > 0.0 || config.drop_rate > 0.0 ||
+               config.channel_down_interval > 0 || config.reset_interval > 0;
+    }
+
+    /**
+     * Apply the configured faults to a received flit. Called by the recv
+     * thread only, so the faults only depend on the seed and the number
+     * of received flits. Only the number of flits lost by a reset depends
+     * on how fast the RX FIFO is drained.
+     *
+     * data: received flit, bits may get flipped
+     *
+     * returns false if the flit is lost
+     */
+    bool inject_faults(data_stream_t &data) {
+        fault_position++;
+        if (config.reset_interval > 0 &&
+            fault_position % config.reset_interval == 0) {
+            channel_down_count++;
+            line_down_count++;
+            rx_discard += rx_fifo_level();
+        }
+        if (config.channel_down_interval > 0 &&
+            fault_position % config.channel_down_interval == 0) {
+            hard_err_count++;
+            channel_down_count++;
+            line_down_count++;
+            channel_down_left = config.channel_down_flits;
+        }
+        bool lost = false;
+        if (channel_down_left > 0) {
+            channel_down_left--;
+            lost = true;
+        } else if (config.drop_rate > 0.0 &&
+                   fault_dist(fault_rng) < config.drop_rate) {
+            soft_err_count++;
+            lost = true;
+        } else if (config.bit_flip_rate > 0.0 &&
+                   fault_dist(fault_rng) < config.bit_flip_rate) {
+            soft_err_count++;
+            data.data ^= ap_uint<512>(1) << (fault_rng() % 512);
+            frame_corrupted = true;
+        }
+        if (lost) {
+            // the frame is merged with the next one if TLAST is lost
+            lost_flits++;
+            frame_corrupted = true;
+            return false;
+        }
+        if (data.last) {
+            // the CRC is only checked in framing mode
+            if (frame_corrupted && config.framing) {
+                frames_with_errors++;
+            }
+            frame_corrupted = false;
+        }
+        return true;
+    }
+
+    /**
+     * Update the counters and the modeled line usage for a batch of flits
+     *
+     * returns the line bits of the batch
+     */
+    uint64_t account_batch(unsigned int count) {
+        uint64_t frames = 0;
+        uint64_t bytes = 0;
+        uint64_t blocks = 0;
+        for (unsigned int i = 0; i < count; i++) {
+            unsigned int valid = __builtin_popcountll(batch[i].keep.to_uint64());
+            bytes += valid;
+            if (config.framing) {
+                // only valid bytes are transmitted in framing mode
+                blocks += (valid + AURORA_BLOCK_BYTES - 1) / AURORA_BLOCK_BYTES;
+                if (batch[i].last) {
+                    frames++;
+                    blocks += config.frame_overhead_bytes / AURORA_BLOCK_BYTES;
+                }
+            } else {
+                blocks += sizeof(ap_uint<512>) / AURORA_BLOCK_BYTES;
+                if (batch[i].last) {
+                    frames++;
+                }
+            }
+        }
+        tx_count += count;
+        frames_transmitted += frames;
+        payload_bytes += bytes;
+        line_bits += blocks * AURORA_BLOCK_LINE_BITS;
+        return blocks * AURORA_BLOCK_LINE_BITS;
+    }
+
+    /**
+     * Sleep until a user stream is ready or the endpoint is shutting down.
+     * The thread is woken up by notify() and by the destructor. Since
+     * hlslib::Stream cannot notify on its own, the condition is checked
+     * again every user_poll_interval microseconds.
+     *
+     * ready: condition on the user stream
+     *
+     * returns false if the endpoint is shutting down
+     */
+    template <typename Ready>
+    bool wait_for_user(Ready ready) {
+        // fast path without lock while data is streaming
+        if (ready()) {
+            return running;
+        }
+        std::unique_lock<std::mutex> lock(user_mutex);
+        user_waiting++;
+        while (running && !ready()) {
+            user_cv.wait_for(
+                lock, std::chrono::microseconds(config.user_poll_interval));
+        }
+        user_waiting--;
+        return running;
+    }
+
+    /**
+     * Wait until the user kernel writes data and collect it with all
+     * further flits that are already available in the TX stream in batch.
+     *
+     * returns the number of flits in the batch or 0 if the endpoint is
+     * shutting down
+     */
+    unsigned int collect_batch() {
+        if (!wait_for_user([this] { return !user_to_remote.empty(); })) {
+            return 0;
+        }
+        data_stream_t data = user_to_remote.read();
+        unsigned int count = 0;
+        batch[count++] = data;
+        while (count < config.batch_size && !data.last &&
+               !user_to_remote.empty()) {
+            data = user_to_remote.read();
+            batch[count++] = data;
+        }
+        pace(account_batch(count));
+        return count;
+    }
+
+    /**
+     * Collect a batch from the TX stream and encode it into a message
+     *
+     * msg: message that is rebuilt to contain the encoded batch
+     *
+     * returns false if the endpoint is shutting down
+     */
+    bool read_batch(zmq::message_t &msg) {
+        unsigned int count = collect_batch();
+        if (count == 0) {
+            return false;
+        }
+
+        // encode sideband bits
+        size_t words = bitmap_words(count);
+        uint64_t *last = wire_buffer.data() +
+                         sizeof(AuroraEmuBatchHeader) / sizeof(uint64_t);
+        uint64_t *partial = last + words;
+        uint64_t *keep = partial + words;
+        std::fill(last, keep, 0);
+        uint32_t partial_keeps = 0;
+        for (unsigned int i = 0; i < count; i++) {
+            if (batch[i].last) {
+                last[i / 64] |= 1ull << (i % 64);
+            }
+            if (~batch[i].keep) {
+                partial[i / 64] |= 1ull << (i % 64);
+                keep[partial_keeps++] = batch[i].keep.to_uint64();
+            }
+        }
+        AuroraEmuBatchHeader header = {AURORA_EMU_DATA, count, partial_keeps,
+                                       0, 0};
+        std::memcpy(wire_buffer.data(), &header, sizeof(header));
+
+        // append data
+        char *flits = reinterpret_cast<char *>(keep + partial_keeps);
+        for (unsigned int i = 0; i < count; i++) {
+            std::memcpy(flits + i * sizeof(ap_uint<512>), &batch[i].data,
+                        sizeof(ap_uint<512>));
+        }
+        msg.rebuild(wire_buffer.data(),
+                    wire_words(count, partial_keeps) * sizeof(uint64_t));
+        return true;
+    }
+
+    /**
+     * Block while the remote core or the switch requested to stop sending.
+     * Has to be called before sending data.
+     *
+     * returns false if the endpoint is shutting down
+     */
+    bool wait_for_xon() {
+        std::unique_lock<std::mutex> lock(tx_mutex);
+        tx_cv.wait(lock,
+                   [this] { return (!tx_paused && !tx_held) || !running; });
+        return running;
+    }
+
+    /**
+     * Advance the state machine of the NFC after the level of the RX FIFO
+     * changed by one flit. Follows aurora_flow_nfc, so the latency counts
+     * the flits that are received after XOFF until the FIFO level drops
+     * below prog_full again.
+     *
+     * The recv thread and the drain thread both call it, so XOFF and XON
+     * are sent with nfc_mutex held. Otherwise an XOFF could overtake the
+     * XON that follows it and leave the sender paused forever.
+     *
+     * received: a flit was pushed into the FIFO
+     */
+    void update_nfc(bool received) {
+        // fast path without lock if no transition is possible
+        if (!nfc_transition(nfc_state, rx_level)) {
+            if (received && nfc_state == NFC_FULL) {
+                latency_count++;
+            }
+            return;
+        }
+        std::lock_guard<std::mutex> lock(nfc_mutex);
+        size_t level = rx_level;
+        switch (nfc_state) {
+            case NFC_IDLE:
+                if (level <= config.rx_fifo_prog_empty) {
+                    empty_trigger_count++;
+                    nfc_state = NFC_EMPTY;
+                    send_nfc(AURORA_EMU_NFC_XON);
+                } else if (level >= config.rx_fifo_prog_full) {
+                    full_trigger_count++;
+                    latency_count = 0;
+                    nfc_state = NFC_FULL;
+                    send_nfc(AURORA_EMU_NFC_XOFF);
+                }
+                break;
+            case NFC_EMPTY:
+                if (level > config.rx_fifo_prog_empty) {
+                    nfc_state = NFC_IDLE;
+                }
+                break;
+            case NFC_FULL:
+                if (level < config.rx_fifo_prog_full) {
+                    if (latency_count > max_latency) {
+                        max_latency = latency_count.load();
+                    }
+                    latency_count = 0;
+                    nfc_state = NFC_IDLE;
+                } else if (received) {
+                    latency_count++;
+                }
+                break;
+        }
+    }
+
+    bool nfc_transition(NfcState state, size_t level) {
+        switch (state) {
+            case NFC_IDLE:
+                return level <= config.rx_fifo_prog_empty ||
+                       level >= config.rx_fifo_prog_full;
+            case NFC_EMPTY:
+                return level > config.rx_fifo_prog_empty;
+            case NFC_FULL:
+                return level < config.rx_fifo_prog_full;
+        }
+        return false;
+    }
+
+    /**
+     * Append a flit to the RX FIFO. Called by the recv thread only. Without
+     * NFC, it sleeps while the FIFO is full until the drain thread pops a
+     * flit.
+     *
+     * returns false if the endpoint is shutting down
+     */
+    bool push_rx(const data_stream_t &data) {
+        if (!config.nfc && rx_level >= config.rx_fifo_depth) {
+            std::unique_lock<std::mutex> lock(rx_mutex);
+            // the drain thread is only notified after the whole batch, so
+            // it may still sleep although the FIFO is full
+            if (drain_waiting) {
+                rx_cv.notify_all();
+            }
+            recv_waiting = true;
+            rx_space_cv.wait(lock, [this] {
+                return rx_level < config.rx_fifo_depth || !running;
+            });
+            recv_waiting = false;
+            if (!running) {
+                return false;
+            }
+        }
+        if (rx_level >= config.rx_fifo_depth) {
+            fifo_rx_overflow_count++;
+        }
+        // count the flit before it is published, so the drain thread
+        // cannot pop it first and wrap the level below zero
+        rx_level++;
+        // keep the order while flits are waiting in the overflow buffer
+        if (rx_overflow_size > 0 || !rx_ring.push(data)) {
+            std::lock_guard<std::mutex> lock(rx_mutex);
+            rx_overflow.push_back(data);
+            rx_overflow_size++;
+        }
+        return true;
+    }
+
+    /**
+     * Take the oldest flit from the RX FIFO. Called by the drain thread
+     * only.
+     *
+     * returns false if the FIFO is empty
+     */
+    bool pop_rx(data_stream_t &data) {
+        if (!rx_ring.pop(data)) {
+            if (rx_overflow_size == 0) {
+                return false;
+            }
+            std::lock_guard<std::mutex> lock(rx_mutex);
+            data = rx_overflow.front();
+            rx_overflow.pop_front();
+            rx_overflow_size--;
+        }
+        rx_level--;
+        if (recv_waiting) {
+            std::lock_guard<std::mutex> lock(rx_mutex);
+            rx_space_cv.notify_all();
+        }
+        return true;
+    }
+
+    /**
+     * Write a flit to the RX stream. Waits while the stream is full instead
+     * of blocking on it, so the destructor can terminate the thread if the
+     * user kernel stopped reading
+     *
+     * returns false if the endpoint is shutting down
+     */
+    bool write_to_user(const data_stream_t &data) {
+        if (!wait_for_user([this] { return !remote_to_user.full(); })) {
+            return false;
+        }
+        remote_to_user.write(data);
+        return true;
+    }
+
+    /**
+     * Pass the flits in the RX FIFO on to the user kernel
+     */
+    void forward_to_user() {
+        data_stream_t data;
+        while (true) {
+            if (!pop_rx(data)) {
+                // sleep until the recv thread pushes new flits
+                std::unique_lock<std::mutex> lock(rx_mutex);
+                drain_waiting = true;
+                rx_cv.wait(lock, [this] {
+                    return rx_level > 0 || !running;
+                });
+                drain_waiting = false;
+                if (!running) {
+                    return;
+                }
+                continue;
+            }
+            if (config.nfc) {
+                update_nfc(false);
+            }
+            if (rx_discard > 0) {
+                // flushed by an injected reset
+                rx_discard--;
+                lost_flits++;
+                continue;
+            }
+            rx_count++;
+            if (data.last) {
+                frames_received++;
+            }
+            if (!write_to_user(data)) {
+                return;
+            }
+        }
+    }
+
+    void start_drain_thread() {
+        if (!drain_thread.joinable()) {
+            drain_thread = std::thread(&AuroraEmuEndpoint::forward_to_user, this);
+        }
+    }
+
+    /**
+     * Handle a message received from a remote core. Batches are unpacked
+     * into the RX FIFO, NFC messages pause or resume the send thread.
+     *
+     * msg: message that contains an encoded batch or NFC message
+     */
+    void receive(const zmq::message_t &msg) {
+        AuroraEmuBatchHeader header;
+        if (msg.size() < sizeof(header)) {
+            throw std::runtime_error("Received message with invalid size");
+        }
+        std::memcpy(&header, msg.data(), sizeof(header));
+        if (msg.size() != wire_words(header.flits, header.partial_keeps) *
+                              sizeof(uint64_t)) {
+            throw std::runtime_error("Received message with invalid size");
+        }
+        if (header.type != AURORA_EMU_DATA) {
+            std::lock_guard<std::mutex> lock(tx_mutex);
+            if (header.type == AURORA_EMU_SWITCH_HOLD ||
+                header.type == AURORA_EMU_SWITCH_RELEASE) {
+                tx_held = (header.type == AURORA_EMU_SWITCH_HOLD);
+            } else {
+                tx_paused = (header.type == AURORA_EMU_NFC_XOFF);
+            }
+            tx_cv.notify_all();
+            return;
+        }
+        delay_delivery(header.timestamp);
+        size_t words = bitmap_words(header.flits);
+        const uint64_t *last =
+            static_cast<const uint64_t *>(msg.data()) +
+            sizeof(AuroraEmuBatchHeader) / sizeof(uint64_t);
+        const uint64_t *partial = last + words;
+        const uint64_t *keep = partial + words;
+        const char *flits =
+            reinterpret_cast<const char *>(keep + header.partial_keeps);
+        bool faults = faults_enabled();
+        for (uint32_t i = 0; i < header.flits; i++) {
+            data_stream_t data;
+            std::memcpy(&data.data, flits + i * sizeof(ap_uint<512>),
+                        sizeof(ap_uint<512>));
+            data.last = (last[i / 64] >> (i % 64)) & 1;
+            if ((partial[i / 64] >> (i % 64)) & 1) {
+                data.keep = *(keep++);
+            } else {
+                data.keep = -1;
+            }
+            if (faults && !inject_faults(data)) {
+                continue;
+            }
+            if (!push_rx(data)) {
+                return;
+            }
+            if (config.nfc) {
+                update_nfc(true);
+            }
+        }
+        if (drain_waiting) {
+            std::lock_guard<std::mutex> lock(rx_mutex);
+            rx_cv.notify_all();
+        }
+    }
+
+   public:
+    // number of flits read from the TX stream
+    uint64_t get_tx_count() { return tx_count; }
+
+    // number of flits written to the RX stream
+    uint64_t get_rx_count() { return rx_count; }
+
+    // number of flits with TLAST set read from the TX stream
+    uint64_t get_frames_transmitted() { return frames_transmitted; }
+
+    // number of flits with TLAST set written to the RX stream
+    uint64_t get_frames_received() { return frames_received; }
+
+    // number of valid bytes according to TKEEP read from the TX stream
+    uint64_t get_payload_bytes() { return payload_bytes; }
+
+    // number of bits the real link would have spent on the transmitted data
+    uint64_t get_line_bits() { return line_bits; }
+
+    /**
+     * Ratio of payload to line bits of the transmitted data. Multiplied
+     * with the line rate, this gives the throughput that can be expected
+     * from the hardware for the same traffic.
+     */
+    double get_line_efficiency() {
+        uint64_t bits = line_bits;
+        return bits ? (8.0 * payload_bytes) / bits : 0.0;
+    }
+
+    // number of times XOFF was sent
+    uint32_t get_nfc_full_trigger_count() { return full_trigger_count; }
+
+    // number of times XON was sent
+    uint32_t get_nfc_empty_trigger_count() { return empty_trigger_count; }
+
+    // maximum number of flits received after sending XOFF
+    uint32_t get_nfc_latency_count() { return max_latency; }
+
+    // number of flits received while the RX FIFO was full
+    uint32_t get_fifo_rx_overflow_count() { return fifo_rx_overflow_count; }
+
+    // number of injected bit flips and randomly dropped flits
+    uint32_t get_soft_err_count() { return soft_err_count; }
+
+    // number of injected channel down windows
+    uint32_t get_hard_err_count() { return hard_err_count; }
+
+    // number of injected channel down windows and resets
+    uint32_t get_channel_down_count() { return channel_down_count; }
+
+    // all lanes go down together, so the four counters are the same
+    uint32_t get_line_down_0_count() { return line_down_count; }
+    uint32_t get_line_down_1_count() { return line_down_count; }
+    uint32_t get_line_down_2_count() { return line_down_count; }
+    uint32_t get_line_down_3_count() { return line_down_count; }
+
+    // number of received frames with injected faults, if framing is
+    // modeled
+    uint32_t get_frames_with_errors() { return frames_with_errors; }
+
+    // number of flits lost by injected faults
+    uint64_t get_lost_flits() { return lost_flits; }
+
+    /**
+     * Wake up the send thread after writing into the TX stream and the
+     * drain thread after reading from a full RX stream. Without it, they
+     * notice the change only after user_poll_interval microseconds.
+     */
+    void notify() {
+        if (user_waiting > 0) {
+            std::lock_guard<std::mutex> lock(user_mutex);
+            user_cv.notify_all();
+        }
+    }
+
+   protected:
+    /**
+     * Clear running and wake up all threads that wait for the user
+     * streams, the RX FIFO or XON. Nothing is written into the user
+     * streams. Called first by the destructors.
+     */
+    void stop() {
+        {
+            std::lock_guard<std::mutex> rx_lock(rx_mutex);
+            std::lock_guard<std::mutex> tx_lock(tx_mutex);
+            std::lock_guard<std::mutex> user_lock(user_mutex);
+            running = false;
+        }
+        rx_cv.notify_all();
+        rx_space_cv.notify_all();
+        tx_cv.notify_all();
+        user_cv.notify_all();
+    }
+
+    /**
+     * Join the drain thread and the send thread after stop(). The recv
+     * thread has to be joined before, because it may still push flits
+     * into the RX FIFO.
+     */
+    void join_threads(std::thread &send_thread) {
+        if (drain_thread.joinable()) {
+            drain_thread.join();
+        }
+        if (send_thread.joinable()) {
+            send_thread.join();
+        }
+    }
+};
+
+class AuroraEmu : public AuroraEmuEndpoint {
    private:
     // ZMQ sockets used to exchange data between Aurora cores
     zmq::context_t ctx;
     zmq::socket_t sock_out;
     zmq::socket_t sock_in;
 
-    // ZMQ socket used to terminate send and recv threads
+    // ZMQ socket used to terminate the recv thread
     zmq::socket_t kill_socket;
 
     // send and recv threads used to pass data to and from user kernels
     std::thread recv_thread;
     std::thread send_thread;
 
-    // streams used to pass data to and from user kernels
-    hlslib::Stream<data_stream_t> &remote_to_user;
-    hlslib::Stream<data_stream_t> &user_to_remote;
-
     // id that is used to name the socket of the aurora emulator
     // or the network port
     std::string id;
     std::string protocol;
 
+    // rings used instead of the sockets for the shm protocol
+    AuroraEmuShmRing shm_in;
+    AuroraEmuShmRing shm_out;
+
+    bool is_shm() { return protocol == "shm"; }
+
+    // with shared memory, the ring is the RX FIFO
+    size_t rx_fifo_level() override {
+        return is_shm() ? shm_in.level() : rx_level.load();
+    }
+
+    std::string shm_name() { return "/auroraemu_" + id; }
+
+    void shm_forward_from_remote() {
+        data_stream_t data;
+        AuroraEmuBackoff backoff;
+        while (running) {
+            if (!shm_in.pop(data)) {
+                backoff.wait();
+                continue;
+            }
+            backoff.reset();
+            if (faults_enabled() && !inject_faults(data)) {
+                continue;
+            }
+            if (rx_discard > 0) {
+                // flushed by an injected reset
+                rx_discard--;
+                lost_flits++;
+                continue;
+            }
+            rx_count++;
+            if (data.last) {
+                frames_received++;
+            }
+            if (!write_to_user(data)) {
+                return;
+            }
+        }
+    }
+
+    void shm_forward_from_user() {
+        unsigned int count;
+        while ((count = collect_batch()) > 0) {
+            AuroraEmuBackoff backoff;
+            for (unsigned int i = 0; i < count; i++) {
+                // the bounded ring applies back pressure to the sender
+                while (!shm_out.push(batch[i])) {
+                    if (!running) {
+                        return;
+                    }
+                    backoff.wait();
+                }
+                backoff.reset();
+            }
+        }
+    }
+
+    /**
+     * Open the ring of a core that receives data from this core and start
+     * sending
+     */
+    void shm_connect_out(AuroraEmu &receiver) {
+        shm_out.open(receiver.shm_name());
+        send_thread = std::thread(&AuroraEmu::shm_forward_from_user, this);
+    }
+
     void forward_from_remote() {
         zmq::socket_t kill_listener(ctx, zmq::socket_type::sub);
         kill_listener.connect("inproc://kill_" + id);
@@ -60,9 +1368,7 @@ class AuroraEmu {
             zmq::poll(&items[0], 2);
             if (items[0].revents & ZMQ_POLLIN) {
                 auto result = sock_in.recv(msg, zmq::recv_flags::none);
-                data_stream_t data;
-                data.data = *static_cast<ap_uint<512> *>(msg.data());
-                remote_to_user.write(data);
+                receive(msg);
             }
             if (items[1].revents & ZMQ_POLLIN) {
                 break;
@@ -71,82 +1377,113 @@ class AuroraEmu {
     }
 
     void forward_from_user() {
-        zmq::socket_t kill_listener(ctx, zmq::socket_type::sub);
-        kill_listener.connect("inproc://kill_" + id);
-        kill_listener.set(zmq::sockopt::subscribe, "");
-        while (true) {
-            // check if stream is empty. If so, sleep a bit to reduce CPU load
-            while (user_to_remote.empty()) {
-                std::this_thread::sleep_for(
-                    std::chrono::milliseconds(RECV_POLL_INTERVAL));
-                // check for kill signals in between
-                zmq::message_t m;
-                if (kill_listener.recv(m, zmq::recv_flags::dontwait)
-                        .has_value()) {
-                    return;
-                }
+        zmq::message_t msg;
+        // forward outgoing data to remote
+        while (read_batch(msg)) {
+            if (!wait_for_xon()) {
+                return;
             }
-            // forward incoming data to user kernel
-            ap_uint<512> data = user_to_remote.read().data;
-            zmq::message_t msg(static_cast<void *>(&data),
-                               sizeof(ap_uint<512>));
+            std::lock_guard<std::mutex> lock(socket_mutex);
+            stamp(msg);
             sock_out.send(msg, zmq::send_flags::none);
         }
     }
 
+    void send_nfc(AuroraEmuMessageType type) override {
+        // NFC messages travel back on the same link as the data
+        zmq::message_t msg;
+        build_nfc(msg, type);
+        std::lock_guard<std::mutex> lock(socket_mutex);
+        sock_out.send(msg, zmq::send_flags::none);
+    }
+
    public:
     AuroraEmu(std::string host_address, int port,
               hlslib::Stream<data_stream_t> &user_to_remote,
-              hlslib::Stream<data_stream_t> &remote_to_user)
-        : ctx(1),
+              hlslib::Stream<data_stream_t> &remote_to_user,
+              AuroraEmuConfig config = AuroraEmuConfig())
+        : AuroraEmuEndpoint(user_to_remote, remote_to_user, config),
+          ctx(1),
           sock_out(ctx, zmq::socket_type::pub),
           sock_in(ctx, zmq::socket_type::sub),
           kill_socket(ctx, zmq::socket_type::pub),
-          user_to_remote(user_to_remote),
-          remote_to_user(remote_to_user),
           id(host_address + ":" + std::to_string(port)),
           protocol("tcp") {
+        set_lossless(sock_out);
         sock_out.bind(protocol + "://" + id);
         kill_socket.bind("inproc://kill_" + id);
     }
 
+    /**
+     * Construct an aurora core that is connected via a named pipe or, if
+     * the name starts with shm://, via a ring in shared memory. Shared
+     * memory bypasses ZMQ, but only works for cores on the same host.
+     *
+     * pipe_name: name of the pipe, optionally prefixed with shm://
+     * user_to_remote: AXI stream to pass data into the aurora core
+     * remote_to_user: AXI stream to read data from the aurora core
+     * config: configuration of the emulated link. With shared memory, the
+     *         ring has rx_fifo_depth flits and applies back pressure
+     *         directly, so the NFC is not used
+     */
     AuroraEmu(std::string pipe_name,
               hlslib::Stream<data_stream_t> &user_to_remote,
-              hlslib::Stream<data_stream_t> &remote_to_user)
-        : ctx(1),
+              hlslib::Stream<data_stream_t> &remote_to_user,
+              AuroraEmuConfig config = AuroraEmuConfig())
+        : AuroraEmuEndpoint(user_to_remote, remote_to_user, config),
+          ctx(1),
           sock_out(ctx, zmq::socket_type::pub),
           sock_in(ctx, zmq::socket_type::sub),
           kill_socket(ctx, zmq::socket_type::pub),
-          user_to_remote(user_to_remote),
-          remote_to_user(remote_to_user),
           id(pipe_name),
           protocol("ipc") {
-        sock_out.bind(protocol + "://" + id);
+        if (pipe_name.compare(0, 6, "shm://") == 0) {
+            id = pipe_name.substr(6);
+            protocol = "shm";
+            shm_in.create(shm_name(), this->config.rx_fifo_depth);
+        } else {
+            set_lossless(sock_out);
+            sock_out.bind(protocol + "://" + id);
+        }
         kill_socket.bind("inproc://kill_" + id);
     }
 
     ~AuroraEmu() {
         // send kill signal to all threads
-        // and wait for them to join
+        // and wait for them to join. The shm threads poll the flag instead
+        // of the kill socket
+        stop();
         zmq::message_t t(0);
         kill_socket.send(t, zmq::send_flags::none);
         if (recv_thread.joinable()) {
             recv_thread.join();
         }
-        if (send_thread.joinable()) {
-            send_thread.join();
-        }
+        join_threads(send_thread);
     }
 
     void connect(AuroraEmu &other_core, bool bidirectional = true) {
         if ((get_address() != other_core.get_address()) && bidirectional)
             other_core.connect(*this, false);
+        if (is_shm()) {
+            if (!other_core.is_shm()) {
+                throw std::invalid_argument(
+                    "Cores with shared memory can only be connected to each "
+                    "other");
+            }
+            // receive data from the other core via the own ring
+            other_core.shm_connect_out(*this);
+            recv_thread =
+                std::thread(&AuroraEmu::shm_forward_from_remote, this);
+            return;
+        }
+        set_lossless(sock_in);
         sock_in.connect(other_core.get_address());
         sock_in.set(zmq::sockopt::subscribe, "");
         std::thread t1(&AuroraEmu::forward_from_remote, this);
         std::thread t2(&AuroraEmu::forward_from_user, this);
         recv_thread.swap(t1);
         send_thread.swap(t2);
+        start_drain_thread();
         std::this_thread::sleep_for(
             std::chrono::milliseconds(RECV_POLL_INTERVAL));
     }
@@ -154,6 +1491,42 @@ class AuroraEmu {
     std::string get_address() { return protocol + "://" + id; }
 };
 
+/**
+ * Statistics of a port of the switch, i.e. of the messages addressed to
+ * one core
+ */
+struct AuroraEmuPortStats {
+    // flits handed over to ZMQ for delivery to the core
+    uint64_t forwarded_flits = 0;
+    // flits currently waiting in the switch, because the core is not
+    // connected yet or does not receive fast enough (routed mode only)
+    uint64_t queued_flits = 0;
+    // maximum of queued_flits
+    uint64_t max_queued_flits = 0;
+    // flits that were still queued when the switch was destroyed
+    uint64_t dropped_flits = 0;
+    // number of times the cores sending to the core were told to hold,
+    // because the queue was full
+    uint64_t holds = 0;
+};
+
+/**
+ * Configuration of an emulated switch
+ */
+struct AuroraEmuSwitchConfig {
+    // deliver messages only to the addressed core via a ROUTER socket and
+    // propagate back pressure to the senders instead of publishing them
+    // to all subscribers. Cores have to be configured with
+    // AuroraEmuConfig::routed as well
+    bool routed = false;
+    // number of flits the switch queues per port in routed mode before it
+    // tells the cores sending to the port to hold. They are released when
+    // the queue drained to half of it. Messages that are already on the
+    // way are still queued. Only if a queue grows to twice the size, the
+    // switch stops receiving messages from all cores
+    unsigned int max_queued_flits = DEFAULT_MAX_QUEUED_FLITS;
+};
+
 class AuroraEmuSwitch {
    private:
     // ZMQ sockets used to exchange data between Aurora cores
@@ -171,25 +1544,243 @@ class AuroraEmuSwitch {
     // ZMQ address of the kill socket for this switch
     std::string kill_id;
 
+    AuroraEmuSwitchConfig config;
+
+    // message that could not be delivered yet in routed mode
+    struct QueuedMessage {
+        zmq::message_t sender;
+        zmq::message_t content;
+        uint32_t flits;
+    };
+
+    // messages per destination that could not be delivered yet. Only used
+    // by the switch thread
+    std::map<std::string, std::deque<QueuedMessage>> queues;
+
+    // cores per destination that were told to hold. Only used by the
+    // switch thread
+    std::map<std::string, std::set<std::string>> held;
+
+    // statistics per destination
+    std::mutex stats_mutex;
+    std::map<std::string, AuroraEmuPortStats> stats;
+
+    static uint32_t count_flits(const zmq::message_t &content) {
+        AuroraEmuBatchHeader header;
+        if (content.size() < sizeof(header)) {
+            return 0;
+        }
+        std::memcpy(&header, content.data(), sizeof(header));
+        return header.flits;
+    }
+
     void forward_data() {
         zmq::message_t msg;
+        std::string destination;
         // listen to kill signals and data coming in
         zmq::pollitem_t items[] = {{incoming, 0, ZMQ_POLLIN, 0},
                                    {kill_listener, 0, ZMQ_POLLIN, 0}};
         while (true) {
             zmq::poll(&items[0], 2);
             if (items[0].revents & ZMQ_POLLIN) {
-                // forward topic
-                auto result = incoming.recv(msg, zmq::recv_flags::none);
-                distributor.send(msg, zmq::send_flags::sndmore);
-                // forward content
-                result = incoming.recv(msg, zmq::recv_flags::none);
-                distributor.send(msg, zmq::send_flags::none);
+                // forward topic, sender and content
+                bool first = true;
+                do {
+                    auto result = incoming.recv(msg, zmq::recv_flags::none);
+                    if (first) {
+                        destination.assign(static_cast<char *>(msg.data()),
+                                           msg.size());
+                        first = false;
+                    } else if (!msg.more()) {
+                        std::lock_guard<std::mutex> lock(stats_mutex);
+                        stats[destination].forwarded_flits += count_flits(msg);
+                    }
+                    distributor.send(msg, msg.more()
+                                              ? zmq::send_flags::sndmore
+                                              : zmq::send_flags::none);
+                } while (msg.more());
+            }
+            if (items[1].revents & ZMQ_POLLIN) {
+                break;
+            }
+        }
+    }
+
+    /**
+     * Try to deliver a message to a core without blocking
+     *
+     * returns false if the core is not connected or its queue in ZMQ is full
+     */
+    bool try_send(const std::string &destination, zmq::message_t &sender,
+                  zmq::message_t &content) {
+        zmq::message_t a_id(destination.data(), destination.size());
+        try {
+            // the first frame decides if the message can be delivered
+            auto result = incoming.send(
+                a_id, zmq::send_flags::sndmore | zmq::send_flags::dontwait);
+            if (!result) {
+                return false;
+            }
+        } catch (const zmq::error_t &e) {
+            if (e.num() == EHOSTUNREACH) {
+                return false;
+            }
+            throw;
+        }
+        incoming.send(sender,
+                      zmq::send_flags::sndmore | zmq::send_flags::dontwait);
+        incoming.send(content, zmq::send_flags::dontwait);
+        return true;
+    }
+
+    /**
+     * Send HOLD or RELEASE to a core without blocking. The sender frame is
+     * empty, so the core does not mistake the switch for a data sender.
+     *
+     * returns false if the message could not be delivered
+     */
+    bool send_control(const std::string &core, AuroraEmuMessageType type) {
+        AuroraEmuBatchHeader header = {type, 0, 0, 0, 0};
+        zmq::message_t sender;
+        zmq::message_t content(&header, sizeof(header));
+        return try_send(core, sender, content);
+    }
+
+    /**
+     * Tell a core that sends to a full queue to hold. If the core cannot
+     * be reached, it is retried with its next message.
+     */
+    void hold_sender(const std::string &destination,
+                     const std::string &sender) {
+        std::set<std::string> &h = held[destination];
+        if (h.count(sender) == 0 &&
+            send_control(sender, AURORA_EMU_SWITCH_HOLD)) {
+            h.insert(sender);
+            std::lock_guard<std::mutex> lock(stats_mutex);
+            stats[destination].holds++;
+        }
+    }
+
+    /**
+     * Release the cores that hold for a destination
+     *
+     * returns true if a release could not be delivered yet
+     */
+    bool release_senders(const std::string &destination) {
+        std::set<std::string> &h = held[destination];
+        for (auto it = h.begin(); it != h.end();) {
+            if (send_control(*it, AURORA_EMU_SWITCH_RELEASE)) {
+                it = h.erase(it);
+            } else {
+                it++;
+            }
+        }
+        return !h.empty();
+    }
+
+    /**
+     * Deliver queued messages in order until a queue blocks and release
+     * the senders of queues that drained
+     *
+     * full: set if a queue reached the hard limit of twice
+     *       max_queued_flits
+     *
+     * returns true if messages or releases are left
+     */
+    bool flush_queues(bool &full) {
+        bool left = false;
+        full = false;
+        for (auto &q : queues) {
+            uint64_t delivered = 0;
+            while (!q.second.empty()) {
+                QueuedMessage &m = q.second.front();
+                if (!try_send(q.first, m.sender, m.content)) {
+                    break;
+                }
+                delivered += m.flits;
+                q.second.pop_front();
+            }
+            uint64_t queued;
+            {
+                std::lock_guard<std::mutex> lock(stats_mutex);
+                AuroraEmuPortStats &port = stats[q.first];
+                port.forwarded_flits += delivered;
+                port.queued_flits -= delivered;
+                queued = port.queued_flits;
+            }
+            if (!q.second.empty()) {
+                left = true;
+                full |= (queued >= 2 * (uint64_t)config.max_queued_flits);
+            }
+            if (queued <= config.max_queued_flits / 2) {
+                left |= release_senders(q.first);
+            }
+        }
+        return left;
+    }
+
+    void route_data() {
+        zmq::message_t identity, destination, sender, content;
+        // listen to kill signals and data coming in
+        zmq::pollitem_t items[] = {{incoming, 0, ZMQ_POLLIN, 0},
+                                   {kill_listener, 0, ZMQ_POLLIN, 0}};
+        while (true) {
+            bool full = false;
+            bool left = flush_queues(full);
+            // the senders to a full queue are told to hold, so the other
+            // cores are not blocked. Only stop receiving if a queue still
+            // grows to the hard limit. Retry queued messages periodically
+            items[0].events = full ? 0 : ZMQ_POLLIN;
+            zmq::poll(&items[0], 2,
+                      std::chrono::milliseconds(left ? ROUTE_RETRY_INTERVAL
+                                                     : -1));
+            if (items[0].revents & ZMQ_POLLIN) {
+                // routing id of the sending socket. Discard
+                auto result = incoming.recv(identity, zmq::recv_flags::none);
+                result = incoming.recv(destination, zmq::recv_flags::none);
+                result = incoming.recv(sender, zmq::recv_flags::none);
+                result = incoming.recv(content, zmq::recv_flags::none);
+                std::string d(static_cast<char *>(destination.data()),
+                              destination.size());
+                uint32_t flits = count_flits(content);
+                std::deque<QueuedMessage> &q = queues[d];
+                // keep the order if messages are already queued
+                if (q.empty() && try_send(d, sender, content)) {
+                    std::lock_guard<std::mutex> lock(stats_mutex);
+                    stats[d].forwarded_flits += flits;
+                } else {
+                    std::string s(static_cast<char *>(sender.data()),
+                                  sender.size());
+                    QueuedMessage m = {std::move(sender), std::move(content),
+                                       flits};
+                    q.push_back(std::move(m));
+                    uint64_t queued;
+                    {
+                        std::lock_guard<std::mutex> lock(stats_mutex);
+                        AuroraEmuPortStats &port = stats[d];
+                        port.queued_flits += flits;
+                        port.max_queued_flits =
+                            std::max(port.max_queued_flits, port.queued_flits);
+                        queued = port.queued_flits;
+                    }
+                    // only data is held back, NFC has to reach the sender
+                    if (flits > 0 && queued >= config.max_queued_flits) {
+                        hold_sender(d, s);
+                    }
+                }
             }
             if (items[1].revents & ZMQ_POLLIN) {
                 break;
             }
         }
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        for (auto &q : queues) {
+            AuroraEmuPortStats &port = stats[q.first];
+            port.dropped_flits += port.queued_flits;
+            port.queued_flits = 0;
+        }
+        queues.clear();
+        held.clear();
     }
 
    public:
@@ -198,14 +1789,17 @@ class AuroraEmuSwitch {
      * to listen for incoming connections. Thread has to be started with
      * additional call to listen()
      *
+     * config: configuration of the switch
      */
-    AuroraEmuSwitch()
+    AuroraEmuSwitch(AuroraEmuSwitchConfig config = AuroraEmuSwitchConfig())
         : ctx(1),
-          incoming(ctx, zmq::socket_type::pull),
+          incoming(ctx, config.routed ? zmq::socket_type::router
+                                      : zmq::socket_type::pull),
           distributor(ctx, zmq::socket_type::pub),
           kill_socket(ctx, zmq::socket_type::pub),
           kill_listener(ctx, zmq::socket_type::sub),
-          kill_id("") {}
+          kill_id(""),
+          config(config) {}
 
     /**
      * Construct and connect a new aurora switch and start thread
@@ -213,9 +1807,13 @@ class AuroraEmuSwitch {
      *
      * host_address: IP address or name of the host machine
      * port: Port of the aurora switch. port and port+1 will be used to
-     *      establish the switch functionality.
+     *      establish the switch functionality. In routed mode, only port
+     *      is used
+     * config: configuration of the switch
      */
-    AuroraEmuSwitch(std::string host_address, int port) : AuroraEmuSwitch() {
+    AuroraEmuSwitch(std::string host_address, int port,
+                    AuroraEmuSwitchConfig config = AuroraEmuSwitchConfig())
+        : AuroraEmuSwitch(config) {
         this->listen(host_address, port);
     }
 
@@ -223,18 +1821,43 @@ class AuroraEmuSwitch {
         if (!switch_thread.joinable()) {
             kill_id =
                 "inproc://kill_" + host_address + "_" + std::to_string(port);
-            incoming.bind("tcp://" + host_address + ":" + std::to_string(port));
-            distributor.bind("tcp://" + host_address + ":" +
-                             std::to_string(port + 1));
+            if (config.routed) {
+                // fail instead of silently dropping messages to unknown
+                // or blocked cores, so they can be queued
+                incoming.set(zmq::sockopt::router_mandatory, true);
+                incoming.bind("tcp://" + host_address + ":" +
+                              std::to_string(port));
+            } else {
+                incoming.bind("tcp://" + host_address + ":" +
+                              std::to_string(port));
+                set_lossless(distributor);
+                distributor.bind("tcp://" + host_address + ":" +
+                                 std::to_string(port + 1));
+            }
             kill_socket.bind(kill_id);
             kill_listener.connect(kill_id);
             kill_listener.set(zmq::sockopt::subscribe, "");
-            switch_thread = std::thread(&AuroraEmuSwitch::forward_data, this);
+            if (config.routed) {
+                switch_thread = std::thread(&AuroraEmuSwitch::route_data, this);
+            } else {
+                switch_thread =
+                    std::thread(&AuroraEmuSwitch::forward_data, this);
+            }
         } else {
             throw std::runtime_error("Switch already running!");
         }
     }
 
+    /**
+     * Statistics of the messages addressed to a core
+     *
+     * id: ID of the core
+     */
+    AuroraEmuPortStats get_port_stats(const std::string &id) {
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        return stats[id];
+    }
+
     ~AuroraEmuSwitch() {
         // send kill signal to all threads
         // and wait for them to join
@@ -246,29 +1869,204 @@ class AuroraEmuSwitch {
     }
 };
 
-class AuroraEmuCore {
+/**
+ * Point-to-point link between two Aurora cores. Cores are named by node,
+ * card and channel like in changeFPGAlinksXilinx, e.g. n00:acl0:ch1
+ */
+struct AuroraEmuLink {
+    std::string a;
+    std::string b;
+};
+
+/**
+ * Links between the emulated cores, described with the same fpgalink
+ * arguments that are passed to changeFPGAlinksXilinx in the run scripts
+ */
+class AuroraEmuTopology {
+   private:
+    std::vector<AuroraEmuLink> links;
+
+    // index of the link per core
+    std::map<std::string, size_t> link_of;
+
+   public:
+    AuroraEmuTopology() {}
+
+    /**
+     * Construct a topology from fpgalink arguments
+     *
+     * description: links in the format of changeFPGAlinksXilinx, e.g.
+     *              "--fpgalink=n00:acl0:ch1-n00:acl1:ch0 ...". The
+     *              --fpgalink= prefix is optional. Other words like srun
+     *              or changeFPGAlinksXilinx and comments starting with #
+     *              are ignored, so lines of the run scripts can be used
+     */
+    explicit AuroraEmuTopology(const std::string &description) {
+        add_links(description);
+    }
+
+    /**
+     * Read a topology from a file with fpgalink arguments
+     *
+     * path: path of the topology file
+     */
+    static AuroraEmuTopology from_file(const std::string &path) {
+        std::ifstream file(path);
+        if (!file) {
+            throw std::runtime_error("Could not open topology file " + path);
+        }
+        std::stringstream content;
+        content << file.rdbuf();
+        return AuroraEmuTopology(content.str());
+    }
+
+    /**
+     * Add all links of a description in the format of the constructor
+     */
+    void add_links(const std::string &description) {
+        static const std::regex link_regex(
+            "([^:\\s-]+:acl[0-9]+:ch[0-9]+)-([^:\\s-]+:acl[0-9]+:ch[0-9]+)");
+        const std::string prefix = "--fpgalink=";
+        std::istringstream lines(description);
+        std::string line;
+        while (std::getline(lines, line)) {
+            std::istringstream words(line.substr(0, line.find('#')));
+            std::string word;
+            while (words >> word) {
+                bool option = (word.compare(0, prefix.size(), prefix) == 0);
+                if (option) {
+                    word = word.substr(prefix.size());
+                }
+                std::smatch match;
+                if (std::regex_match(word, match, link_regex)) {
+                    add_link(match[1], match[2]);
+                } else if (option) {
+                    throw std::invalid_argument("Invalid fpgalink " + word);
+                }
+            }
+        }
+    }
+
+    /**
+     * Add a link between two cores. A core connected to itself is a
+     * loopback. Every core can be part of a single link only
+     */
+    void add_link(const std::string &a, const std::string &b) {
+        if (link_of.count(a) || link_of.count(b)) {
+            throw std::invalid_argument("Channel used by more than one link: " +
+                                        (link_of.count(a) ? a : b));
+        }
+        link_of[a] = links.size();
+        link_of[b] = links.size();
+        links.push_back({a, b});
+    }
+
+    const std::vector<AuroraEmuLink> &get_links() const { return links; }
+
+    /**
+     * Index of the link a core is part of
+     *
+     * id: name of the core
+     */
+    size_t get_link(const std::string &id) const {
+        auto it = link_of.find(id);
+        if (it == link_of.end()) {
+            throw std::invalid_argument("Channel not part of the topology: " +
+                                        id);
+        }
+        return it->second;
+    }
+
+    /**
+     * Name of the core at the other end of the link
+     *
+     * id: name of the core
+     */
+    std::string get_remote(const std::string &id) const {
+        const AuroraEmuLink &link = links[get_link(id)];
+        return (link.a == id) ? link.b : link.a;
+    }
+
+    /**
+     * Port of the switch that forwards the link of a core. Every link
+     * uses two ports, starting at base_port
+     *
+     * base_port: port of the first link
+     * id: name of the core
+     */
+    int get_port(int base_port, const std::string &id) const {
+        return base_port + 2 * static_cast<int>(get_link(id));
+    }
+};
+
+/**
+ * Switch for a topology of point-to-point links. Every link is forwarded
+ * by its own switch on its own ports and thread, so links do not share a
+ * forwarding loop and the throughput scales with the number of links
+ */
+class AuroraEmuTopologySwitch {
+   private:
+    AuroraEmuTopology topology;
+
+    // one switch per link, in the order of the links in the topology
+    std::vector<std::unique_ptr<AuroraEmuSwitch>> switches;
+
+   public:
+    /**
+     * Construct the switches of all links and start their threads
+     *
+     * host_address: IP address or name of the host machine
+     * base_port: Port of the first link. Link i uses the ports
+     *            base_port + 2 * i and base_port + 2 * i + 1
+     * topology: links between the cores
+     * config: configuration of the switch of every link
+     */
+    AuroraEmuTopologySwitch(
+        std::string host_address, int base_port, AuroraEmuTopology topology,
+        AuroraEmuSwitchConfig config = AuroraEmuSwitchConfig())
+        : topology(topology) {
+        for (size_t i = 0; i < this->topology.get_links().size(); i++) {
+            switches.emplace_back(new AuroraEmuSwitch(
+                host_address, base_port + 2 * static_cast<int>(i), config));
+        }
+    }
+
+    const AuroraEmuTopology &get_topology() const { return topology; }
+
+    /**
+     * Statistics of the messages addressed to a core
+     *
+     * id: name of the core
+     */
+    AuroraEmuPortStats get_port_stats(const std::string &id) {
+        return switches[topology.get_link(id)]->get_port_stats(id);
+    }
+};
+
+class AuroraEmuCore : public AuroraEmuEndpoint {
    private:
     // ZMQ sockets used to exchange data between Aurora cores
     zmq::context_t ctx;
     zmq::socket_t to_switch;
     zmq::socket_t from_switch;
 
-    // ZMQ socket used to terminate send and recv threads
+    // ZMQ socket used to terminate the recv thread
     zmq::socket_t kill_socket;
 
     // send and recv threads used to pass data to and from user kernels
     std::thread recv_thread;
     std::thread send_thread;
 
-    // streams used to pass data to and from user kernels
-    hlslib::Stream<data_stream_t> &remote_to_user;
-    hlslib::Stream<data_stream_t> &user_to_remote;
-
     // id that is used to name the socket of the aurora emulator
     // or the network port
     std::string id;
     std::string remote_id;
 
+    // IDs of the cores that sent data to this core and receive its NFC
+    // messages
+    std::mutex senders_mutex;
+    std::set<std::string> senders;
+
     void forward_from_remote() {
         zmq::socket_t kill_listener(ctx, zmq::socket_type::sub);
         kill_listener.connect("inproc://kill_" + id);
@@ -280,13 +2078,23 @@ class AuroraEmuCore {
         while (true) {
             zmq::poll(&items[0], 2);
             if (items[0].revents & ZMQ_POLLIN) {
-                // receive aurora id of incoming message. Discard
-                auto result = from_switch.recv(msg, zmq::recv_flags::none);
+                zmq::recv_result_t result;
+                if (!config.routed) {
+                    // receive aurora id of incoming message. Discard
+                    result = from_switch.recv(msg, zmq::recv_flags::none);
+                }
+                // receive id of the sender
+                result = from_switch.recv(msg, zmq::recv_flags::none);
+                std::string sender(static_cast<char *>(msg.data()), msg.size());
                 // receive actual message
                 result = from_switch.recv(msg, zmq::recv_flags::none);
-                data_stream_t data;
-                data.data = *static_cast<ap_uint<512> *>(msg.data());
-                remote_to_user.write(data);
+                if (is_data(msg)) {
+                    // NFC only goes back to cores that sent data, not to
+                    // the switch or to cores that only sent NFC
+                    std::lock_guard<std::mutex> lock(senders_mutex);
+                    senders.insert(sender);
+                }
+                receive(msg);
             }
             if (items[1].revents & ZMQ_POLLIN) {
                 break;
@@ -295,28 +2103,37 @@ class AuroraEmuCore {
     }
 
     void forward_from_user() {
-        zmq::socket_t kill_listener(ctx, zmq::socket_type::sub);
-        kill_listener.connect("inproc://kill_" + id);
-        kill_listener.set(zmq::sockopt::subscribe, "");
-        while (true) {
-            // check if stream is empty. If so, sleep a bit to reduce CPU load
-            while (user_to_remote.empty()) {
-                std::this_thread::sleep_for(
-                    std::chrono::milliseconds(RECV_POLL_INTERVAL));
-                // check for kill signals in between
-                zmq::message_t m;
-                if (kill_listener.recv(m, zmq::recv_flags::dontwait)
-                        .has_value()) {
-                    return;
-                }
+        zmq::message_t msg;
+        // forward outgoing data to remote
+        while (read_batch(msg)) {
+            if (!wait_for_xon()) {
+                return;
             }
-            // forward incoming data to user kernel
-            ap_uint<512> data = user_to_remote.read().data;
-            zmq::message_t msg(static_cast<void *>(&data),
-                               sizeof(ap_uint<512>));
-            zmq::message_t a_id(remote_id);
-            to_switch.send(a_id, zmq::send_flags::sndmore);
-            to_switch.send(msg, zmq::send_flags::none);
+            std::lock_guard<std::mutex> lock(socket_mutex);
+            stamp(msg);
+            send_to(remote_id, msg);
+        }
+    }
+
+    /**
+     * Send a message via the switch. Has to be called with socket_mutex
+     * held. Blocks in routed mode if the switch applies back pressure.
+     */
+    void send_to(const std::string &destination, zmq::message_t &msg) {
+        zmq::message_t a_id(destination);
+        zmq::message_t s_id(id);
+        to_switch.send(a_id, zmq::send_flags::sndmore);
+        to_switch.send(s_id, zmq::send_flags::sndmore);
+        to_switch.send(msg, zmq::send_flags::none);
+    }
+
+    void send_nfc(AuroraEmuMessageType type) override {
+        std::lock_guard<std::mutex> senders_lock(senders_mutex);
+        std::lock_guard<std::mutex> lock(socket_mutex);
+        for (const std::string &sender : senders) {
+            zmq::message_t msg;
+            build_nfc(msg, type);
+            send_to(sender, msg);
         }
     }
 
@@ -331,43 +2148,77 @@ class AuroraEmuCore {
      * remote_id: ID of the aurora core to connect to
      * user_to_remote: AXI stream to pass data into the aurora core
      * remote_to_user: AXI stream to read data from the aurora core
+     * config: configuration of the emulated link
      */
     AuroraEmuCore(std::string switch_address, int switch_port, std::string id,
                   std::string remote_id,
                   hlslib::Stream<data_stream_t> &user_to_remote,
-                  hlslib::Stream<data_stream_t> &remote_to_user)
-        : ctx(1),
-          to_switch(ctx, zmq::socket_type::push),
-          from_switch(ctx, zmq::socket_type::sub),
+                  hlslib::Stream<data_stream_t> &remote_to_user,
+                  AuroraEmuConfig config = AuroraEmuConfig())
+        : AuroraEmuEndpoint(user_to_remote, remote_to_user, config),
+          ctx(1),
+          to_switch(ctx, config.routed ? zmq::socket_type::dealer
+                                       : zmq::socket_type::push),
+          from_switch(ctx, config.routed ? zmq::socket_type::dealer
+                                         : zmq::socket_type::sub),
           kill_socket(ctx, zmq::socket_type::pub),
-          user_to_remote(user_to_remote),
-          remote_to_user(remote_to_user),
           id(id),
           remote_id(remote_id) {
         kill_socket.bind("inproc://kill_" + id);
         to_switch.connect("tcp://" + switch_address + ":" +
                           std::to_string(switch_port));
-        from_switch.connect("tcp://" + switch_address + ":" +
-                            std::to_string(switch_port + 1));
-        from_switch.set(zmq::sockopt::subscribe, id);
+        if (this->config.routed) {
+            // the switch addresses this core by the routing id of the
+            // receiving socket
+            from_switch.set(zmq::sockopt::routing_id, id);
+            from_switch.connect("tcp://" + switch_address + ":" +
+                                std::to_string(switch_port));
+        } else {
+            set_lossless(from_switch);
+            from_switch.connect("tcp://" + switch_address + ":" +
+                                std::to_string(switch_port + 1));
+            from_switch.set(zmq::sockopt::subscribe, id);
+        }
         std::thread t1(&AuroraEmuCore::forward_from_remote, this);
         std::thread t2(&AuroraEmuCore::forward_from_user, this);
         recv_thread.swap(t1);
         send_thread.swap(t2);
+        start_drain_thread();
         std::this_thread::sleep_for(
             std::chrono::milliseconds(RECV_POLL_INTERVAL));
     }
 
+    /**
+     * Construct an aurora core as part of a topology and connect it to the
+     * switch of its link
+     *
+     * switch_address: IP address or name of the host machine the
+     *                 AuroraEmuTopologySwitch is running on
+     * base_port: Port of the first link of the AuroraEmuTopologySwitch
+     * topology: links between the cores
+     * id: name of the core in the topology, e.g. n00:acl0:ch1
+     * user_to_remote: AXI stream to pass data into the aurora core
+     * remote_to_user: AXI stream to read data from the aurora core
+     * config: configuration of the emulated link
+     */
+    AuroraEmuCore(std::string switch_address, int base_port,
+                  const AuroraEmuTopology &topology, std::string id,
+                  hlslib::Stream<data_stream_t> &user_to_remote,
+                  hlslib::Stream<data_stream_t> &remote_to_user,
+                  AuroraEmuConfig config = AuroraEmuConfig())
+        : AuroraEmuCore(switch_address, topology.get_port(base_port, id), id,
+                        topology.get_remote(id), user_to_remote,
+                        remote_to_user, config) {}
+
     ~AuroraEmuCore() {
         // send kill signal to all threads
         // and wait for them to join
+        stop();
         zmq::message_t t(0);
         kill_socket.send(t, zmq::send_flags::none);
         if (recv_thread.joinable()) {
             recv_thread.join();
         }
-        if (send_thread.joinable()) {
-            send_thread.join();
-        }
+        join_threads(send_thread);
     }
 };
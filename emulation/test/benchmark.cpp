@@ -0,0 +1,378 @@
+/*
+ * Copyright 2024 Marius Meyer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "auroraemu.hpp"
+#include "hlslib/xilinx/Stream.h"
+
+/**
+ * Send a single flit back and forth between two emulated cores and
+ * measure the round trip time. A thread on the remote side echoes every
+ * flit it receives, so every round trip starts from an idle send path.
+ *
+ * a1, in1/out1: local core and its streams
+ * a2, in2/out2: remote core and its streams
+ * notify: wake up the send threads with notify() after every write.
+ *         Otherwise they notice the flit after user_poll_interval
+ * round_trips: number of measured round trips
+ */
+void ping_pong(std::string name, AuroraEmuEndpoint &a1,
+               hlslib::Stream<data_stream_t> &in1,
+               hlslib::Stream<data_stream_t> &out1, AuroraEmuEndpoint &a2,
+               hlslib::Stream<data_stream_t> &in2,
+               hlslib::Stream<data_stream_t> &out2, bool notify,
+               int round_trips) {
+    std::thread echo([&a2, &in2, &out2, notify, round_trips]() {
+        for (int i = 0; i < round_trips + 1; i++) {
+            in2.write(out2.read());
+            if (notify) {
+                a2.notify();
+            }
+        }
+    });
+    std::vector<double> times;
+    for (int i = 0; i < round_trips + 1; i++) {
+        data_stream_t data;
+        data.data = ap_uint<512>(i);
+        auto start = std::chrono::steady_clock::now();
+        in1.write(data);
+        if (notify) {
+            a1.notify();
+        }
+        out1.read();
+        auto end = std::chrono::steady_clock::now();
+        // first round trip includes connection setup
+        if (i > 0) {
+            times.push_back(
+                std::chrono::duration<double, std::micro>(end - start)
+                    .count());
+        }
+    }
+    echo.join();
+    std::sort(times.begin(), times.end());
+    double sum = 0.0;
+    for (double t : times) {
+        sum += t;
+    }
+    std::cout << std::setw(16) << name << std::setw(12) << round_trips
+              << std::setw(14) << times.front() << std::setw(14)
+              << sum / times.size() << std::setw(14)
+              << times[times.size() / 2] << std::setw(14) << times.back()
+              << std::endl;
+}
+
+/**
+ * Stream a burst of flits from one emulated core to the other and measure
+ * the achieved bandwidth. The burst is written into the TX stream before
+ * the measurement starts, so the send path can coalesce flits up to the
+ * configured batch size.
+ *
+ * a1, in1: sending core and its TX stream
+ * out2: RX stream of the receiving core
+ * flits: number of flits in the burst
+ */
+void throughput(std::string name, unsigned int batch_size,
+                AuroraEmuEndpoint &a1, hlslib::Stream<data_stream_t> &in1,
+                hlslib::Stream<data_stream_t> &out2, int flits) {
+    auto start = std::chrono::steady_clock::now();
+    std::thread sender([&a1, &in1, flits]() {
+        for (int i = 0; i < flits; i++) {
+            data_stream_t data;
+            data.data = ap_uint<512>(i);
+            data.last = (i == flits - 1);
+            in1.write(data);
+            a1.notify();
+        }
+    });
+    for (int i = 0; i < flits; i++) {
+        out2.read();
+    }
+    auto end = std::chrono::steady_clock::now();
+    sender.join();
+    double seconds = std::chrono::duration<double>(end - start).count();
+    double bytes = static_cast<double>(flits) * sizeof(ap_uint<512>);
+    std::cout << std::setw(16) << name << std::setw(12) << batch_size
+              << std::setw(12) << flits << std::setw(14) << seconds * 1.0e3
+              << std::setw(14) << bytes / seconds / 1.0e9 * 8.0 << std::endl;
+}
+
+// interval of the send threads before they were woken up on write. They
+// slept RECV_POLL_INTERVAL milliseconds whenever the TX stream was empty
+const unsigned int OLD_POLL_INTERVAL = RECV_POLL_INTERVAL * 1000;
+
+// round trips measured with the old poll interval, each takes 100 to 200 ms
+const int OLD_POLL_ROUND_TRIPS = 10;
+
+// depth of the streams used for the throughput benchmark
+const unsigned int BENCHMARK_STREAM_DEPTH = 4096;
+
+typedef hlslib::Stream<data_stream_t, BENCHMARK_STREAM_DEPTH> deep_stream_t;
+
+/**
+ * Stream a burst of frames through a pair of cores that model the Aurora
+ * framing interface and report the line efficiency the hardware would
+ * reach for the same frame size.
+ *
+ * frame_size: number of flits per frame
+ * flits: number of flits in the burst
+ */
+void framing(unsigned int frame_size, int flits) {
+    deep_stream_t in1("in1"), out1("out1"), in2("in2"), out2("out2");
+    AuroraEmuConfig config;
+    config.framing = true;
+    AuroraEmu a1("bench_a1", in1, out1, config);
+    AuroraEmu a2("bench_a2", in2, out2, config);
+    a1.connect(a2);
+    auto start = std::chrono::steady_clock::now();
+    std::thread sender([&a1, &in1, flits, frame_size]() {
+        for (int i = 0; i < flits; i++) {
+            data_stream_t data;
+            data.data = ap_uint<512>(i);
+            data.keep = -1;
+            data.last = (((i + 1) % frame_size) == 0) || ((i + 1) == flits);
+            in1.write(data);
+            a1.notify();
+        }
+    });
+    for (int i = 0; i < flits; i++) {
+        out2.read();
+    }
+    auto end = std::chrono::steady_clock::now();
+    sender.join();
+    double seconds = std::chrono::duration<double>(end - start).count();
+    double bytes = static_cast<double>(flits) * sizeof(ap_uint<512>);
+    double efficiency = a1.get_line_efficiency();
+    std::cout << std::setw(12) << frame_size << std::setw(12)
+              << a2.get_frames_received() << std::setw(14)
+              << bytes / seconds / 1.0e9 * 8.0 << std::setw(14) << efficiency
+              << std::setw(14)
+              << efficiency * AURORA_LANES * AURORA_LANE_RATE / 1.0e9
+              << std::endl;
+}
+
+/**
+ * Stream a burst of flits over several links at the same time and measure
+ * the aggregate bandwidth. The links are either forwarded by a single
+ * switch or by an AuroraEmuTopologySwitch with a switch per link.
+ *
+ * links: number of links, link i connects n00:acl<i>:ch0 to n00:acl<i>:ch1
+ * per_link: use a switch per link
+ * flits: number of flits in the burst of every link
+ */
+void parallel_links(unsigned int links, bool per_link, int flits) {
+    std::string description;
+    for (unsigned int i = 0; i < links; i++) {
+        description += "--fpgalink=n00:acl" + std::to_string(i) +
+                       ":ch0-n00:acl" + std::to_string(i) + ":ch1 ";
+    }
+    AuroraEmuTopology topology(description);
+    std::unique_ptr<AuroraEmuSwitch> hub;
+    std::unique_ptr<AuroraEmuTopologySwitch> s;
+    if (per_link) {
+        s.reset(new AuroraEmuTopologySwitch("127.0.0.1", 20000, topology));
+    } else {
+        hub.reset(new AuroraEmuSwitch("127.0.0.1", 20000));
+    }
+    std::vector<std::unique_ptr<deep_stream_t>> in, out;
+    std::vector<std::unique_ptr<AuroraEmuCore>> cores;
+    for (const AuroraEmuLink &link : topology.get_links()) {
+        for (const std::string &id : {link.a, link.b}) {
+            in.emplace_back(new deep_stream_t("in"));
+            out.emplace_back(new deep_stream_t("out"));
+            if (per_link) {
+                cores.emplace_back(new AuroraEmuCore("127.0.0.1", 20000,
+                                                     topology, id, *in.back(),
+                                                     *out.back()));
+            } else {
+                cores.emplace_back(new AuroraEmuCore(
+                    "127.0.0.1", 20000, id, topology.get_remote(id),
+                    *in.back(), *out.back()));
+            }
+        }
+    }
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (unsigned int i = 0; i < links; i++) {
+        AuroraEmuCore &core = *cores[2 * i];
+        deep_stream_t &tx = *in[2 * i];
+        deep_stream_t &rx = *out[2 * i + 1];
+        threads.emplace_back([&core, &tx, flits]() {
+            for (int f = 0; f < flits; f++) {
+                data_stream_t data;
+                data.data = ap_uint<512>(f);
+                data.last = (f == flits - 1);
+                tx.write(data);
+                core.notify();
+            }
+        });
+        threads.emplace_back([&rx, flits]() {
+            for (int f = 0; f < flits; f++) {
+                rx.read();
+            }
+        });
+    }
+    for (std::thread &t : threads) {
+        t.join();
+    }
+    auto end = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(end - start).count();
+    double bytes =
+        static_cast<double>(flits) * links * sizeof(ap_uint<512>);
+    std::cout << std::setw(16) << (per_link ? "per link" : "single hub")
+              << std::setw(12) << links << std::setw(12) << flits
+              << std::setw(14) << seconds * 1.0e3 << std::setw(14)
+              << bytes / seconds / 1.0e9 * 8.0 << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    int round_trips = 1000;
+    if (argc > 1) {
+        round_trips = std::stoi(argv[1]);
+    }
+    int flits = 100000;
+    if (argc > 2) {
+        flits = std::stoi(argv[2]);
+    }
+
+    std::cout << "Ping-pong latency of a single flit (us)" << std::endl
+              << std::setw(16) << "Connection" << std::setw(12) << "Trips"
+              << std::setw(14) << "Min." << std::setw(14) << "Avg."
+              << std::setw(14) << "Median" << std::setw(14) << "Max."
+              << std::endl
+              << std::setw(84) << std::setfill('-') << "-" << std::endl
+              << std::setfill(' ');
+
+    {
+        // before: the send thread only checked the TX stream every
+        // RECV_POLL_INTERVAL milliseconds
+        AuroraEmuConfig config;
+        config.user_poll_interval = OLD_POLL_INTERVAL;
+        hlslib::Stream<data_stream_t> in1("in1"), out1("out1"), in2("in2"),
+            out2("out2");
+        AuroraEmu a1("bench_a1", in1, out1, config);
+        AuroraEmu a2("bench_a2", in2, out2, config);
+        a1.connect(a2);
+        ping_pong("ipc 100 ms poll", a1, in1, out1, a2, in2, out2, false,
+                  std::min(round_trips, OLD_POLL_ROUND_TRIPS));
+    }
+
+    {
+        hlslib::Stream<data_stream_t> in1("in1"), out1("out1"), in2("in2"),
+            out2("out2");
+        AuroraEmu a1("bench_a1", in1, out1);
+        AuroraEmu a2("bench_a2", in2, out2);
+        a1.connect(a2);
+        ping_pong("ipc poll", a1, in1, out1, a2, in2, out2, false,
+                  round_trips);
+    }
+
+    {
+        hlslib::Stream<data_stream_t> in1("in1"), out1("out1"), in2("in2"),
+            out2("out2");
+        AuroraEmu a1("bench_a1", in1, out1);
+        AuroraEmu a2("bench_a2", in2, out2);
+        a1.connect(a2);
+        ping_pong("ipc", a1, in1, out1, a2, in2, out2, true, round_trips);
+    }
+
+    {
+        hlslib::Stream<data_stream_t> in1("in1"), out1("out1"), in2("in2"),
+            out2("out2");
+        AuroraEmu a1("shm://bench_a1", in1, out1);
+        AuroraEmu a2("shm://bench_a2", in2, out2);
+        a1.connect(a2);
+        ping_pong("shm", a1, in1, out1, a2, in2, out2, true, round_trips);
+    }
+
+    {
+        hlslib::Stream<data_stream_t> in1("in1"), out1("out1"), in2("in2"),
+            out2("out2");
+        AuroraEmuSwitch s("127.0.0.1", 20000);
+        AuroraEmuCore a1("127.0.0.1", 20000, "a1", "a2", in1, out1);
+        AuroraEmuCore a2("127.0.0.1", 20000, "a2", "a1", in2, out2);
+        ping_pong("switch", a1, in1, out1, a2, in2, out2, true, round_trips);
+    }
+
+    std::cout << std::endl
+              << "Throughput of a burst of flits (Gbit/s)" << std::endl
+              << std::setw(16) << "Connection" << std::setw(12) << "Batch"
+              << std::setw(12) << "Flits" << std::setw(14) << "Time (ms)"
+              << std::setw(14) << "Gbit/s" << std::endl
+              << std::setw(68) << std::setfill('-') << "-" << std::endl
+              << std::setfill(' ');
+
+    for (unsigned int batch_size : {1, 4, 16, 64, 256, 1024}) {
+        AuroraEmuConfig config;
+        config.batch_size = batch_size;
+        {
+            deep_stream_t in1("in1"), out1("out1"), in2("in2"), out2("out2");
+            AuroraEmu a1("bench_a1", in1, out1, config);
+            AuroraEmu a2("bench_a2", in2, out2, config);
+            a1.connect(a2);
+            throughput("ipc", batch_size, a1, in1, out2, flits);
+        }
+        {
+            deep_stream_t in1("in1"), out1("out1"), in2("in2"), out2("out2");
+            AuroraEmuSwitch s("127.0.0.1", 20000);
+            AuroraEmuCore a1("127.0.0.1", 20000, "a1", "a2", in1, out1,
+                             config);
+            AuroraEmuCore a2("127.0.0.1", 20000, "a2", "a1", in2, out2,
+                             config);
+            throughput("switch", batch_size, a1, in1, out2, flits);
+        }
+    }
+
+    {
+        // shared memory does not batch, every flit is passed separately
+        deep_stream_t in1("in1"), out1("out1"), in2("in2"), out2("out2");
+        AuroraEmu a1("shm://bench_a1", in1, out1);
+        AuroraEmu a2("shm://bench_a2", in2, out2);
+        a1.connect(a2);
+        throughput("shm", 1, a1, in1, out2, flits);
+    }
+
+    std::cout << std::endl
+              << "Modeled framing overhead over frame sizes" << std::endl
+              << std::setw(12) << "Frame size" << std::setw(12) << "Frames"
+              << std::setw(14) << "Emu. Gbit/s" << std::setw(14)
+              << "Efficiency" << std::setw(14) << "Line Gbit/s" << std::endl
+              << std::setw(66) << std::setfill('-') << "-" << std::endl
+              << std::setfill(' ');
+
+    for (unsigned int frame_size = 1; frame_size <= 4096; frame_size *= 4) {
+        framing(frame_size, flits);
+    }
+
+    std::cout << std::endl
+              << "Aggregate throughput over parallel links (Gbit/s)"
+              << std::endl
+              << std::setw(16) << "Switch" << std::setw(12) << "Links"
+              << std::setw(12) << "Flits" << std::setw(14) << "Time (ms)"
+              << std::setw(14) << "Gbit/s" << std::endl
+              << std::setw(68) << std::setfill('-') << "-" << std::endl
+              << std::setfill(' ');
+
+    for (unsigned int links : {1, 2, 3}) {
+        parallel_links(links, false, flits);
+        parallel_links(links, true, flits);
+    }
+}
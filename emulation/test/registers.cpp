@@ -0,0 +1,169 @@
+/*
+ * Copyright 2024 Marius Meyer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+#include "Aurora.hpp"
+#include "auroraemu.hpp"
+#include "gtest/gtest.h"
+#include "hlslib/xilinx/Stream.h"
+
+/**
+ * Register file of the host code fed by a pair of emulated cores
+ */
+struct EmulatedAuroraRegistersTest : public ::testing::Test {
+    // in1 holds all data, out2 is shallow so the RX FIFO of a2 fills up
+    hlslib::Stream<data_stream_t, 200> in1;
+    hlslib::Stream<data_stream_t> out1, in2, out2;
+    AuroraEmuConfig config;
+    std::unique_ptr<AuroraEmu> a1;
+    std::unique_ptr<AuroraEmu> a2;
+    std::shared_ptr<EmulatedAuroraRegisters> registers1;
+    std::shared_ptr<EmulatedAuroraRegisters> registers2;
+
+    EmulatedAuroraRegistersTest()
+        : in1("in1"), out1("out1"), in2("in2"), out2("out2") {
+        config.batch_size = 1;
+        config.rx_fifo_depth = 256;
+        config.rx_fifo_prog_full = 64;
+        config.rx_fifo_prog_empty = 8;
+    }
+
+    void SetUp() {
+        a1.reset(new AuroraEmu("registers_a1", in1, out1, config));
+        a2.reset(new AuroraEmu("registers_a2", in2, out2, config));
+        a1->connect(*a2);
+        registers1 = std::make_shared<EmulatedAuroraRegisters>();
+        registers2 = std::make_shared<EmulatedAuroraRegisters>();
+        registers1->connect(*a1);
+        registers2->connect(*a2);
+    }
+
+    void TearDown() {
+        // the register files reference the cores, so they go first
+        registers1.reset();
+        registers2.reset();
+        a1.reset();
+        a2.reset();
+    }
+
+    void send(int flits) {
+        for (int i = 0; i < flits; i++) {
+            data_stream_t data;
+            data.data = ap_uint<512>(i);
+            in1.write(data);
+        }
+    }
+};
+
+TEST_F(EmulatedAuroraRegistersTest, CountersFollowCore) {
+    Aurora aurora1(registers1);
+    Aurora aurora2(registers2);
+    EXPECT_TRUE(aurora1.core_status_ok(0));
+    send(100);
+    // the RX FIFO fills up, because nothing is read from out2
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    EXPECT_EQ(aurora2.get_nfc_full_trigger_count(), 1u);
+    EXPECT_EQ(aurora2.get_nfc_empty_trigger_count(), 0u);
+    for (int i = 0; i < 100; i++) {
+        EXPECT_EQ(out2.read().data, ap_uint<512>(i));
+    }
+    EXPECT_EQ(aurora1.get_tx_count(), 100u);
+    EXPECT_EQ(aurora2.get_rx_count(), 100u);
+    EXPECT_GE(aurora2.get_nfc_empty_trigger_count(), 1u);
+    EXPECT_EQ(aurora2.get_nfc_latency_count(), a2->get_nfc_latency_count());
+    EXPECT_EQ(aurora2.get_fifo_rx_overflow_count(), 0u);
+    // the other direction was not used
+    EXPECT_EQ(aurora2.get_tx_count(), 0u);
+    EXPECT_EQ(aurora1.get_rx_count(), 0u);
+}
+
+TEST_F(EmulatedAuroraRegistersTest, ResetCounterKeepsCore) {
+    Aurora aurora1(registers1);
+    Aurora aurora2(registers2);
+    send(50);
+    for (int i = 0; i < 50; i++) {
+        out2.read();
+    }
+    aurora1.reset_counter();
+    aurora2.reset_counter();
+    // the counters of the core keep running, the registers read the
+    // difference to the reset
+    EXPECT_EQ(a1->get_tx_count(), 50u);
+    EXPECT_EQ(aurora1.get_tx_count(), 0u);
+    EXPECT_EQ(aurora2.get_rx_count(), 0u);
+    send(30);
+    for (int i = 0; i < 30; i++) {
+        out2.read();
+    }
+    EXPECT_EQ(aurora1.get_tx_count(), 30u);
+    EXPECT_EQ(aurora2.get_rx_count(), 30u);
+}
+
+TEST_F(EmulatedAuroraRegistersTest, ConnectResetsOffsets) {
+    send(20);
+    for (int i = 0; i < 20; i++) {
+        out2.read();
+    }
+    // connecting again starts at zero like a freshly programmed core
+    registers1->connect(*a1);
+    Aurora aurora1(registers1);
+    EXPECT_EQ(aurora1.get_tx_count(), 0u);
+    send(5);
+    for (int i = 0; i < 5; i++) {
+        out2.read();
+    }
+    EXPECT_EQ(aurora1.get_tx_count(), 5u);
+}
+
+TEST_F(EmulatedAuroraRegistersTest, SnapshotLatchesCounters) {
+    Aurora aurora1(registers1);
+    Aurora aurora2(registers2);
+    send(40);
+    for (int i = 0; i < 40; i++) {
+        out2.read();
+    }
+    aurora1.snapshot();
+    aurora2.snapshot();
+    EXPECT_EQ(aurora1.get_snapshot_tx_count(), 40u);
+    EXPECT_EQ(aurora1.get_snapshot_tx_bytes(), 40u * 64);
+    EXPECT_EQ(aurora2.get_snapshot_rx_count(), 40u);
+    EXPECT_EQ(aurora2.get_snapshot_rx_bytes(), 40u * 64);
+    EXPECT_EQ(aurora1.get_snapshot_rx_bytes(), 0u);
+    uint64_t cycles = aurora1.get_snapshot_cycle_count();
+    EXPECT_GT(cycles, 0u);
+    // the latched values stay until the next snapshot
+    send(10);
+    for (int i = 0; i < 10; i++) {
+        out2.read();
+    }
+    EXPECT_EQ(aurora1.get_snapshot_tx_count(), 40u);
+    EXPECT_EQ(aurora1.get_snapshot_cycle_count(), cycles);
+    aurora1.snapshot();
+    EXPECT_EQ(aurora1.get_snapshot_tx_count(), 50u);
+    EXPECT_EQ(aurora1.get_snapshot_tx_bytes(), 50u * 64);
+    EXPECT_GT(aurora1.get_snapshot_cycle_count(), cycles);
+}
+
+int main(int argc, char *argv[]) {
+    ::testing::InitGoogleTest(&argc, argv);
+
+    bool result = RUN_ALL_TESTS();
+
+    return result;
+}
@@ -14,12 +14,62 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <atomic>
+#include <cstdlib>
 #include <iostream>
+#include <new>
 
 #include "auroraemu.hpp"
 #include "gtest/gtest.h"
 #include "hlslib/xilinx/Stream.h"
 
+// number of heap allocations, used to check that the hot paths of the
+// emulator do not allocate
+static std::atomic<size_t> allocations(0);
+
+void *operator new(size_t size) {
+    allocations++;
+    void *p = std::malloc(size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+/**
+ * Endpoint without network connection that exposes the send and receive
+ * paths for testing
+ */
+class LocalEndpoint : public AuroraEmuEndpoint {
+   public:
+    LocalEndpoint(hlslib::Stream<data_stream_t> &user_to_remote,
+                  hlslib::Stream<data_stream_t> &remote_to_user,
+                  AuroraEmuConfig config)
+        : AuroraEmuEndpoint(user_to_remote, remote_to_user, config) {}
+
+    void send_nfc(AuroraEmuMessageType type) override {
+        if (type == AURORA_EMU_NFC_XOFF) {
+            xoff_sent++;
+        } else {
+            xon_sent++;
+        }
+        last_nfc = type;
+    }
+
+    std::atomic<uint32_t> xoff_sent{0};
+    std::atomic<uint32_t> xon_sent{0};
+    std::atomic<AuroraEmuMessageType> last_nfc{AURORA_EMU_DATA};
+
+    using AuroraEmuEndpoint::pop_rx;
+    using AuroraEmuEndpoint::read_batch;
+    using AuroraEmuEndpoint::receive;
+    using AuroraEmuEndpoint::update_nfc;
+};
+
 struct AuroraEmuTest : public ::testing::Test {
     AuroraEmuTest() {
         // Empty
@@ -234,6 +284,560 @@ TEST_F(AuroraEmuTest, SwitchDefaultConstructorSend) {
     }
 }
 
+TEST_F(AuroraEmuTest, SwitchBatchedTransfer) {
+    // set depth of streams to hold all data
+    hlslib::Stream<data_stream_t, 200> in1("in1"), out1("out1"), in2("in2"),
+        out2("out2");
+    AuroraEmuConfig config;
+    config.batch_size = 16;
+    AuroraEmuSwitch s("127.0.0.1", 20000);
+    AuroraEmuCore a1("127.0.0.1", 20000, "a1", "a2", in1, out1, config);
+    AuroraEmuCore a2("127.0.0.1", 20000, "a2", "a1", in2, out2, config);
+    // write two frames at once so they are split into multiple batches
+    for (int i = 0; i < 200; i++) {
+        data_stream_t data;
+        data.data = ap_uint<512>(i);
+        data.last = (i == 99 || i == 199);
+        in1.write(data);
+    }
+    for (int i = 0; i < 200; i++) {
+        EXPECT_EQ(out2.read().data, ap_uint<512>(i));
+    }
+    EXPECT_TRUE(out2.empty());
+}
+
+TEST_F(AuroraEmuTest, ConstructorBatchSizeThrows) {
+    hlslib::Stream<data_stream_t> in, out;
+    AuroraEmuConfig config;
+    config.batch_size = 0;
+    EXPECT_THROW(AuroraEmu a("20000", in, out, config), std::invalid_argument);
+    config.batch_size = config.rx_fifo_depth + 1;
+    EXPECT_THROW(AuroraEmu a("20000", in, out, config), std::invalid_argument);
+}
+
+TEST_F(AuroraEmuTest, SwitchPreservesSideband) {
+    // set depth of streams to hold all data
+    hlslib::Stream<data_stream_t, 200> in1("in1"), out1("out1"), in2("in2"),
+        out2("out2");
+    AuroraEmuConfig config;
+    config.framing = true;
+    AuroraEmuSwitch s("127.0.0.1", 20000);
+    AuroraEmuCore a1("127.0.0.1", 20000, "a1", "a2", in1, out1, config);
+    AuroraEmuCore a2("127.0.0.1", 20000, "a2", "a1", in2, out2, config);
+    // frames of 10 flits with a partial keep in the last flit
+    for (int i = 0; i < 200; i++) {
+        data_stream_t data;
+        data.data = ap_uint<512>(i);
+        data.last = ((i + 1) % 10) == 0;
+        data.keep = data.last ? ap_uint<64>(0xff) : ap_uint<64>(-1);
+        in1.write(data);
+    }
+    for (int i = 0; i < 200; i++) {
+        data_stream_t data = out2.read();
+        EXPECT_EQ(data.data, ap_uint<512>(i));
+        EXPECT_EQ(data.last, ap_uint<1>(((i + 1) % 10) == 0));
+        EXPECT_EQ(data.keep, data.last ? ap_uint<64>(0xff) : ap_uint<64>(-1));
+    }
+    EXPECT_EQ(a1.get_tx_count(), 200u);
+    EXPECT_EQ(a2.get_rx_count(), 200u);
+    EXPECT_EQ(a1.get_frames_transmitted(), 20u);
+    EXPECT_EQ(a2.get_frames_received(), 20u);
+    EXPECT_EQ(a1.get_payload_bytes(), 20u * (9 * 64 + 8));
+    // 9 full flits, one block of the last flit and two blocks overhead
+    EXPECT_EQ(a1.get_line_bits(), 20u * (9 * 8 + 1 + 2 * 4) * 66);
+}
+
+TEST_F(AuroraEmuTest, ConnectFlowControl) {
+    // set depth of streams to hold all data
+    hlslib::Stream<data_stream_t, 200> in1("in1"), out1("out1");
+    hlslib::Stream<data_stream_t> in2("in2"), out2("out2");
+    AuroraEmuConfig config;
+    config.batch_size = 1;
+    config.rx_fifo_depth = 256;
+    config.rx_fifo_prog_full = 64;
+    config.rx_fifo_prog_empty = 8;
+    AuroraEmu a1("20000", in1, out1, config);
+    AuroraEmu a2("20001", in2, out2, config);
+    a1.connect(a2);
+    for (int i = 0; i < 200; i++) {
+        data_stream_t data;
+        data.data = ap_uint<512>(i);
+        in1.write(data);
+        if (i == 99) {
+            // the RX FIFO fills up, because nothing is read from out2
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            EXPECT_EQ(a2.get_nfc_full_trigger_count(), 1u);
+            EXPECT_EQ(a2.get_nfc_empty_trigger_count(), 0u);
+        }
+    }
+    // XOFF stops the sender while out2 is not drained. How many flits
+    // pass before depends on when the XOFF arrives
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    EXPECT_LT(a1.get_tx_count(), 200u);
+    EXPECT_EQ(a2.get_fifo_rx_overflow_count(), 0u);
+    for (int i = 0; i < 200; i++) {
+        EXPECT_EQ(out2.read().data, ap_uint<512>(i));
+    }
+    EXPECT_GE(a2.get_nfc_empty_trigger_count(), 1u);
+    EXPECT_GT(a2.get_nfc_latency_count(), 0u);
+    EXPECT_EQ(a2.get_fifo_rx_overflow_count(), 0u);
+    EXPECT_EQ(a1.get_tx_count(), 200u);
+}
+
+TEST_F(AuroraEmuTest, DestroyWithoutReading) {
+    hlslib::Stream<data_stream_t, 4> in("in"), out("out");
+    AuroraEmuConfig config;
+    config.batch_size = 1;
+    config.rx_fifo_depth = 16;
+    config.rx_fifo_prog_full = 8;
+    config.rx_fifo_prog_empty = 2;
+    {
+        AuroraEmu a("20000", in, out, config);
+        a.connect(a);
+        auto start = std::chrono::steady_clock::now();
+        while (std::chrono::steady_clock::now() - start
+               < std::chrono::milliseconds(200)) {
+            if (!in.full()) {
+                in.write(data_stream_t());
+            } else {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+        // out is never read, so XOFF stops the sender and in stays full
+        EXPECT_TRUE(in.full());
+    }
+    // the destructor returned without writing into the user streams
+    EXPECT_TRUE(in.full());
+}
+
+TEST_F(AuroraEmuTest, ConstructorThresholdsThrow) {
+    hlslib::Stream<data_stream_t> in, out;
+    AuroraEmuConfig config;
+    config.rx_fifo_prog_empty = config.rx_fifo_prog_full;
+    EXPECT_THROW(AuroraEmu a("20000", in, out, config), std::invalid_argument);
+}
+
+TEST_F(AuroraEmuTest, RoutedSwitchLateConnect) {
+    hlslib::Stream<data_stream_t, 200> in1("in1"), out1("out1"), in2("in2"),
+        out2("out2");
+    AuroraEmuSwitchConfig switch_config;
+    switch_config.routed = true;
+    AuroraEmuConfig config;
+    config.routed = true;
+    AuroraEmuSwitch s("127.0.0.1", 20000, switch_config);
+    AuroraEmuCore a1("127.0.0.1", 20000, "a1", "a2", in1, out1, config);
+    // the switch queues the data until a2 is connected
+    for (int i = 0; i < 200; i++) {
+        data_stream_t data;
+        data.data = ap_uint<512>(i);
+        in1.write(data);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    EXPECT_EQ(s.get_port_stats("a2").queued_flits, 200u);
+    AuroraEmuCore a2("127.0.0.1", 20000, "a2", "a1", in2, out2, config);
+    for (int i = 0; i < 200; i++) {
+        EXPECT_EQ(out2.read().data, ap_uint<512>(i));
+    }
+    AuroraEmuPortStats stats = s.get_port_stats("a2");
+    EXPECT_EQ(stats.forwarded_flits, 200u);
+    EXPECT_EQ(stats.queued_flits, 0u);
+    EXPECT_EQ(stats.dropped_flits, 0u);
+}
+
+TEST_F(AuroraEmuTest, RoutedSwitchSlowReceiver) {
+    const int flits = 1 << 20;
+    hlslib::Stream<data_stream_t, 4096> in1("in1"), out1("out1"), in2("in2"),
+        out2("out2");
+    AuroraEmuSwitchConfig switch_config;
+    switch_config.routed = true;
+    AuroraEmuConfig config;
+    config.routed = true;
+    AuroraEmuSwitch s("127.0.0.1", 20000, switch_config);
+    AuroraEmuCore a1("127.0.0.1", 20000, "a1", "a2", in1, out1, config);
+    AuroraEmuCore a2("127.0.0.1", 20000, "a2", "a1", in2, out2, config);
+    std::thread t1([&in1, flits]() {
+        for (int i = 0; i < flits; i++) {
+            data_stream_t data;
+            data.data = ap_uint<512>(i);
+            in1.write(data);
+        }
+    });
+    int errors = 0;
+    for (int i = 0; i < flits; i++) {
+        if (out2.read().data != ap_uint<512>(i)) {
+            errors++;
+        }
+        if ((i % 4096) == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    t1.join();
+    EXPECT_EQ(errors, 0);
+    EXPECT_GT(a2.get_nfc_full_trigger_count(), 0u);
+    AuroraEmuPortStats stats = s.get_port_stats("a2");
+    EXPECT_EQ(stats.forwarded_flits, (uint64_t)flits);
+    EXPECT_EQ(stats.dropped_flits, 0u);
+    EXPECT_LE(stats.max_queued_flits,
+              2 * switch_config.max_queued_flits + config.batch_size);
+}
+
+TEST_F(AuroraEmuTest, RoutedSwitchHoldsSender) {
+    hlslib::Stream<data_stream_t, 16> in1("in1"), out1("out1"), in2("in2"),
+        out2("out2");
+    hlslib::Stream<data_stream_t, 1024> in3("in3"), out3("out3"), in4("in4"),
+        out4("out4");
+    AuroraEmuSwitchConfig switch_config;
+    switch_config.routed = true;
+    switch_config.max_queued_flits = 256;
+    AuroraEmuConfig config;
+    config.routed = true;
+    // without NFC the receiver stops taking messages when its FIFO is full
+    config.nfc = false;
+    config.rx_fifo_depth = 64;
+    config.rx_fifo_prog_full = 32;
+    config.rx_fifo_prog_empty = 8;
+    AuroraEmuSwitch s("127.0.0.1", 20000, switch_config);
+    AuroraEmuCore a1("127.0.0.1", 20000, "a1", "a2", in1, out1, config);
+    AuroraEmuCore a2("127.0.0.1", 20000, "a2", "a1", in2, out2, config);
+    AuroraEmuCore a3("127.0.0.1", 20000, "a3", "a4", in3, out3, config);
+    AuroraEmuCore a4("127.0.0.1", 20000, "a4", "a3", in4, out4, config);
+    // a2 is never read, so its queue in the switch fills up
+    std::atomic<bool> stop(false);
+    std::thread t1([&in1, &stop]() {
+        while (!stop) {
+            if (!in1.full()) {
+                in1.write(data_stream_t());
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    });
+    auto start = std::chrono::steady_clock::now();
+    while (s.get_port_stats("a2").holds == 0 &&
+           std::chrono::steady_clock::now() - start <
+               std::chrono::seconds(10)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_GT(s.get_port_stats("a2").holds, 0u);
+    // traffic between the other cores is not blocked by the full queue
+    for (int i = 0; i < 1000; i++) {
+        data_stream_t data;
+        data.data = ap_uint<512>(i);
+        in3.write(data);
+    }
+    for (int i = 0; i < 1000; i++) {
+        EXPECT_EQ(out4.read().data, ap_uint<512>(i));
+    }
+    stop = true;
+    t1.join();
+    AuroraEmuPortStats stats = s.get_port_stats("a2");
+    EXPECT_LE(stats.max_queued_flits,
+              2 * switch_config.max_queued_flits + config.batch_size);
+    EXPECT_EQ(a2.get_fifo_rx_overflow_count(), 0u);
+}
+
+// only covers unpacking into the RX FIFO and draining it. Receiving from a
+// ZMQ socket allocates the buffer of every message
+TEST_F(AuroraEmuTest, UnpackWithoutAllocation) {
+    hlslib::Stream<data_stream_t, 64> in("in"), out("out");
+    LocalEndpoint e(in, out, AuroraEmuConfig());
+    for (int i = 0; i < 64; i++) {
+        data_stream_t data;
+        data.data = ap_uint<512>(i);
+        data.keep = -1;
+        data.last = (i == 63);
+        in.write(data);
+    }
+    zmq::message_t msg;
+    ASSERT_TRUE(e.read_batch(msg));
+    // unpack the batch into the RX FIFO and drain it repeatedly
+    size_t before = allocations;
+    for (int r = 0; r < 1000; r++) {
+        e.receive(msg);
+        data_stream_t data;
+        for (int i = 0; i < 64; i++) {
+            ASSERT_TRUE(e.pop_rx(data));
+            e.update_nfc(false);
+            EXPECT_EQ(data.data, ap_uint<512>(i));
+        }
+        EXPECT_FALSE(e.pop_rx(data));
+    }
+    EXPECT_EQ(allocations - before, 0u);
+}
+
+TEST_F(AuroraEmuTest, ReceiveShortMessageThrows) {
+    hlslib::Stream<data_stream_t> in("in"), out("out");
+    LocalEndpoint e(in, out, AuroraEmuConfig());
+    zmq::message_t empty;
+    EXPECT_THROW(e.receive(empty), std::runtime_error);
+    zmq::message_t short_msg(sizeof(AuroraEmuBatchHeader) - 1);
+    EXPECT_THROW(e.receive(short_msg), std::runtime_error);
+}
+
+TEST_F(AuroraEmuTest, NfcOrderWithConcurrentDrain) {
+    hlslib::Stream<data_stream_t, 64> in("in"), out("out");
+    AuroraEmuConfig config;
+    config.rx_fifo_depth = 256;
+    config.rx_fifo_prog_full = 64;
+    config.rx_fifo_prog_empty = 8;
+    LocalEndpoint e(in, out, config);
+    for (int i = 0; i < 64; i++) {
+        in.write(data_stream_t());
+    }
+    zmq::message_t msg;
+    ASSERT_TRUE(e.read_batch(msg));
+    // the recv path and the drain path change the NFC state concurrently
+    const int batches = 2000;
+    std::thread drain([&e] {
+        data_stream_t data;
+        for (int i = 0; i < batches * 64; i++) {
+            while (!e.pop_rx(data)) {
+                std::this_thread::yield();
+            }
+            e.update_nfc(false);
+        }
+    });
+    for (int r = 0; r < batches; r++) {
+        e.receive(msg);
+    }
+    drain.join();
+    EXPECT_EQ(e.xoff_sent, e.get_nfc_full_trigger_count());
+    EXPECT_EQ(e.xon_sent, e.get_nfc_empty_trigger_count());
+    // the FIFO is empty again, so the last message has to resume the sender
+    EXPECT_EQ(e.last_nfc, AURORA_EMU_NFC_XON);
+}
+
+TEST_F(AuroraEmuTest, RingOrder) {
+    AuroraEmuRing<int> ring(100);
+    EXPECT_EQ(ring.capacity(), 128u);
+    int value;
+    EXPECT_FALSE(ring.pop(value));
+    for (int r = 0; r < 3; r++) {
+        for (int i = 0; i < 128; i++) {
+            EXPECT_TRUE(ring.push(i));
+        }
+        EXPECT_FALSE(ring.push(128));
+        for (int i = 0; i < 128; i++) {
+            EXPECT_TRUE(ring.pop(value));
+            EXPECT_EQ(value, i);
+        }
+        EXPECT_TRUE(ring.empty());
+    }
+}
+
+TEST_F(AuroraEmuTest, ConnectTwoSharedMemory) {
+    hlslib::Stream<data_stream_t, 200> in1("in1"), out1("out1"), in2("in2"),
+        out2("out2");
+    AuroraEmuConfig config;
+    config.batch_size = 16;
+    config.rx_fifo_depth = 16;
+    config.rx_fifo_prog_full = 8;
+    config.rx_fifo_prog_empty = 2;
+    AuroraEmu a1("shm://a1", in1, out1, config);
+    AuroraEmu a2("shm://a2", in2, out2, config);
+    a1.connect(a2);
+    EXPECT_EQ(a1.get_address(), "shm://a1");
+    // more flits than fit into the ring
+    for (int i = 0; i < 200; i++) {
+        data_stream_t data;
+        data.data = ap_uint<512>(i);
+        data.keep = -1;
+        data.last = ((i + 1) % 10) == 0;
+        in1.write(data);
+    }
+    for (int i = 0; i < 200; i++) {
+        in2.write(out2.read());
+    }
+    for (int i = 0; i < 200; i++) {
+        data_stream_t data = out1.read();
+        EXPECT_EQ(data.data, ap_uint<512>(i));
+        EXPECT_EQ(data.last, ap_uint<1>(((i + 1) % 10) == 0));
+    }
+    EXPECT_EQ(a1.get_frames_received(), 20u);
+    EXPECT_TRUE(out1.empty());
+    EXPECT_TRUE(out2.empty());
+}
+
+TEST_F(AuroraEmuTest, SharedMemoryResetLosesRing) {
+    hlslib::Stream<data_stream_t, 200> in1("in1"), in2("in2");
+    hlslib::Stream<data_stream_t, 4> out1("out1"), out2("out2");
+    AuroraEmuConfig config;
+    config.batch_size = 16;
+    config.rx_fifo_depth = 16;
+    config.rx_fifo_prog_full = 8;
+    config.rx_fifo_prog_empty = 2;
+    config.reset_interval = 50;
+    AuroraEmu a1("shm://a1", in1, out1, config);
+    AuroraEmu a2("shm://a2", in2, out2, config);
+    a1.connect(a2);
+    for (int i = 0; i < 200; i++) {
+        in1.write(data_stream_t());
+    }
+    a1.notify();
+    // out2 is not read yet, so the ring of a2 fills up
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    uint64_t received = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (received + a2.get_lost_flits() < 200 &&
+           std::chrono::steady_clock::now() - start <
+               std::chrono::seconds(10)) {
+        if (!out2.empty()) {
+            out2.read();
+            a2.notify();
+            received++;
+        } else {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    EXPECT_EQ(a2.get_channel_down_count(), 4u);
+    EXPECT_GT(a2.get_lost_flits(), 0u);
+    EXPECT_EQ(received + a2.get_lost_flits(), 200u);
+}
+
+TEST_F(AuroraEmuTest, TopologyParse) {
+    AuroraEmuTopology topology(
+        "srun -n 1 changeFPGAlinksXilinx --fpgalink=n00:acl0:ch1-n00:acl1:ch0 "
+        "--fpgalink=n00:acl1:ch1-n00:acl2:ch0 # ring\n"
+        "n00:acl2:ch1-n00:acl0:ch0\n"
+        "--fpgalink=n01:acl0:ch0-n01:acl0:ch0");
+    EXPECT_EQ(topology.get_links().size(), 4u);
+    EXPECT_EQ(topology.get_remote("n00:acl0:ch1"), "n00:acl1:ch0");
+    EXPECT_EQ(topology.get_remote("n00:acl1:ch0"), "n00:acl0:ch1");
+    EXPECT_EQ(topology.get_remote("n01:acl0:ch0"), "n01:acl0:ch0");
+    EXPECT_EQ(topology.get_port(20000, "n00:acl0:ch0"), 20004);
+    EXPECT_THROW(topology.get_remote("n00:acl3:ch0"), std::invalid_argument);
+    EXPECT_THROW(topology.add_link("n00:acl0:ch1", "n01:acl1:ch0"),
+                 std::invalid_argument);
+    EXPECT_THROW(AuroraEmuTopology("--fpgalink=n00:acl0-n00:acl1:ch0"),
+                 std::invalid_argument);
+}
+
+TEST_F(AuroraEmuTest, TopologyConnectInRing) {
+    hlslib::Stream<data_stream_t> in1("in1"), out1("out1"), in2("in2"),
+        out2("out2"), in3("in3"), out3("out3"), in4("in4"), out4("out4"),
+        in5("in5"), out5("out5"), in6("in6"), out6("out6");
+    AuroraEmuTopology topology(
+        "--fpgalink=n00:acl0:ch1-n00:acl1:ch0 "
+        "--fpgalink=n00:acl1:ch1-n00:acl2:ch0 "
+        "--fpgalink=n00:acl2:ch1-n00:acl0:ch0");
+    AuroraEmuTopologySwitch s("127.0.0.1", 20000, topology);
+    AuroraEmuCore a1("127.0.0.1", 20000, topology, "n00:acl0:ch0", in1, out1);
+    AuroraEmuCore a2("127.0.0.1", 20000, topology, "n00:acl0:ch1", in2, out2);
+    AuroraEmuCore a3("127.0.0.1", 20000, topology, "n00:acl1:ch0", in3, out3);
+    AuroraEmuCore a4("127.0.0.1", 20000, topology, "n00:acl1:ch1", in4, out4);
+    AuroraEmuCore a5("127.0.0.1", 20000, topology, "n00:acl2:ch0", in5, out5);
+    AuroraEmuCore a6("127.0.0.1", 20000, topology, "n00:acl2:ch1", in6, out6);
+    data_stream_t data;
+    data.data = ap_uint<512>(345686);
+    // channel 1 sends to the next card, channel 0 passes on to channel 1
+    in2.write(data);
+    in4.write(out3.read());
+    in6.write(out5.read());
+    in2.write(out1.read());
+    EXPECT_EQ(out3.read().data, ap_uint<512>(345686));
+    EXPECT_EQ(s.get_port_stats("n00:acl1:ch0").forwarded_flits, 2u);
+    EXPECT_EQ(s.get_port_stats("n00:acl0:ch0").forwarded_flits, 1u);
+}
+
+TEST_F(AuroraEmuTest, ConnectBandwidthLimit) {
+    hlslib::Stream<data_stream_t, 200> in1("in1"), out1("out1"), in2("in2"),
+        out2("out2");
+    AuroraEmuConfig config;
+    config.batch_size = 1;
+    // one full flit of 8 blocks per millisecond
+    config.bandwidth = 8 * AURORA_BLOCK_LINE_BITS * 1000.0;
+    AuroraEmu a1("20000", in1, out1, config);
+    AuroraEmu a2("20001", in2, out2, config);
+    a1.connect(a2);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 200; i++) {
+        data_stream_t data;
+        data.data = ap_uint<512>(i);
+        in1.write(data);
+    }
+    for (int i = 0; i < 200; i++) {
+        EXPECT_EQ(out2.read().data, ap_uint<512>(i));
+    }
+    double ms = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+    EXPECT_GE(ms, 199.0);
+}
+
+TEST_F(AuroraEmuTest, ConnectLatency) {
+    hlslib::Stream<data_stream_t> in1("in1"), out1("out1"), in2("in2"),
+        out2("out2");
+    AuroraEmuConfig config;
+    config.latency_ns = 20000000;
+    config.jitter_ns = 5000000;
+    config.seed = 42;
+    AuroraEmu a1("20000", in1, out1, config);
+    AuroraEmu a2("20001", in2, out2, config);
+    a1.connect(a2);
+    for (int i = 0; i < 5; i++) {
+        data_stream_t data;
+        data.data = ap_uint<512>(i);
+        auto start = std::chrono::steady_clock::now();
+        in1.write(data);
+        in2.write(out2.read());
+        EXPECT_EQ(out1.read().data, ap_uint<512>(i));
+        double ms = std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+        EXPECT_GE(ms, 40.0);
+    }
+}
+
+TEST_F(AuroraEmuTest, FaultInjection) {
+    hlslib::Stream<data_stream_t, 64> in("in"), out("out");
+    AuroraEmuConfig config;
+    config.framing = true;
+    config.bit_flip_rate = 0.05;
+    config.channel_down_interval = 100;
+    config.channel_down_flits = 10;
+    config.seed = 42;
+    LocalEndpoint e1(in, out, config);
+    LocalEndpoint e2(in, out, config);
+    // a single frame of 8 flits
+    for (int i = 0; i < 8; i++) {
+        data_stream_t data;
+        data.data = ap_uint<512>(i);
+        data.keep = -1;
+        data.last = (i == 7);
+        in.write(data);
+    }
+    zmq::message_t msg;
+    ASSERT_TRUE(e1.read_batch(msg));
+    // both endpoints see the same faults for the same seed
+    uint64_t received = 0;
+    uint32_t flipped = 0;
+    for (int r = 0; r < 105; r++) {
+        e1.receive(msg);
+        e2.receive(msg);
+        data_stream_t d1, d2;
+        while (e1.pop_rx(d1)) {
+            ASSERT_TRUE(e2.pop_rx(d2));
+            EXPECT_EQ(d1.data, d2.data);
+            received++;
+            // the data of a flit is its index in the batch
+            if (d1.data >= ap_uint<512>(8)) {
+                flipped++;
+            }
+        }
+        EXPECT_FALSE(e2.pop_rx(d2));
+    }
+    EXPECT_EQ(e1.get_hard_err_count(), 8u);
+    EXPECT_EQ(e1.get_channel_down_count(), 8u);
+    EXPECT_EQ(e1.get_line_down_0_count(), 8u);
+    EXPECT_EQ(e1.get_lost_flits(), 80u);
+    EXPECT_EQ(received, 840u - 80u);
+    EXPECT_GT(flipped, 0u);
+    EXPECT_GE(e1.get_soft_err_count(), flipped);
+    EXPECT_GE(e1.get_frames_with_errors(), 8u);
+    EXPECT_EQ(e1.get_soft_err_count(), e2.get_soft_err_count());
+    EXPECT_EQ(e1.get_frames_with_errors(), e2.get_frames_with_errors());
+}
+
 int main(int argc, char *argv[]) {
     ::testing::InitGoogleTest(&argc, argv);
 
@@ -0,0 +1,254 @@
+/*
+ * Copyright 2023-2024 Gerrit Pape (papeg@mail.upb.de)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <hls_stream.h>
+#include <ap_int.h>
+#include <ap_axi_sdata.h>
+
+#ifndef DATA_WIDTH_BYTES
+#define DATA_WIDTH_BYTES 64
+#endif
+
+#define DATA_WIDTH (DATA_WIDTH_BYTES * 8)
+
+// Channel bonding of both aurora cores: the issue and dump kernels of the
+// bonded design are built with flits of BOND_WIDTH bits, twice the width
+// of a core. stripe splits every flit of the issue kernel and sends the
+// lower half on core 0 and the upper half on core 1 in the same cycle, and
+// merge joins them again for the dump kernel, so both cores can run at
+// their line rate. On both cores the halves are sent in blocks of
+// BOND_BLOCK flits, and every block starts with a header flit with the
+// sequence number and the length of the block. merge checks every flit for
+// it, so a lost flit does not shift the data of one core against the other
+// silently: a header inside a block or of a later block makes merge write
+// zeros for the rest of the current block and for the blocks in between
+// and count them as errors. A data flit that starts with the magic number
+// by chance is taken as a header as well. If no flit arrives for timeout
+// cycles, the rest is filled with zeros, so merge and the dump kernel
+// terminate.
+//
+// The header costs one cycle per block, so the bonded link is limited to
+// BOND_WIDTH bits times 64/65 of the kernel clock, about 300 Gbit/s with
+// 1024 bits at 300 MHz, more than both cores together can carry.
+
+#define BOND_WIDTH (2 * DATA_WIDTH)
+
+// data flits per block
+#define BOND_BLOCK 64
+// first 64 bits of a header flit
+#define BOND_MAGIC 0x426f6e6448647221ull
+
+static ap_uint<DATA_WIDTH> bond_header(unsigned int block, unsigned int length)
+{
+#pragma HLS INLINE
+    ap_uint<DATA_WIDTH> header = 0;
+    header.range(63, 0) = BOND_MAGIC;
+    header.range(95, 64) = block;
+    header.range(127, 96) = length;
+    return header;
+}
+
+// number of data flits in a block, only the last one can be shorter
+static unsigned int bond_block_length(unsigned int block, unsigned int flits)
+{
+#pragma HLS INLINE
+    unsigned int left = flits - block * BOND_BLOCK;
+    return left < BOND_BLOCK ? left : BOND_BLOCK;
+}
+
+// state of merge for the flits of one core
+struct MergeCore
+{
+    unsigned int block;
+    // data flits of the current block that are still expected
+    unsigned int left;
+    // zero flits that are still written for lost blocks
+    unsigned int fill;
+    // header of a later block, found while skipping to it
+    bool pending;
+    unsigned int pending_block;
+    unsigned int pending_length;
+    // half of the next output flit, taken from this core
+    bool valid;
+    ap_uint<DATA_WIDTH> data;
+    bool last;
+};
+
+// one cycle of merge on one core: takes the next half of the output flit,
+// either a data flit or a zero flit of a lost block, unless it already has
+// one. flush fills with zeros after the timeout. Returns whether a flit
+// was received and sets waiting if none was there
+static bool merge_core(
+    hls::stream<ap_axiu<DATA_WIDTH, 0, 0, 0>> &data_input,
+    MergeCore &core,
+    unsigned int flits,
+    bool flush,
+    unsigned int &lost,
+    bool &waiting
+) {
+#pragma HLS INLINE
+    ap_axiu<DATA_WIDTH, 0, 0, 0> flit;
+    if (core.valid) {
+        return false;
+    } else if (core.fill > 0 || flush) {
+        core.data = 0;
+        core.last = false;
+        core.valid = true;
+        if (core.fill > 0) {
+            core.fill--;
+            if (core.fill == 0) {
+                core.block++;
+            }
+        }
+    } else if (core.left == 0 && core.pending) {
+        if (core.pending_block == core.block) {
+            core.left = core.pending_length;
+            core.pending = false;
+        } else {
+            core.fill = bond_block_length(core.block, flits);
+            lost++;
+        }
+    } else if (data_input.read_nb(flit)) {
+        if (flit.data.range(63, 0).to_uint64() == BOND_MAGIC) {
+            unsigned int header_block = flit.data.range(95, 64).to_uint();
+            unsigned int header_length = flit.data.range(127, 96).to_uint();
+            if (core.left > 0) {
+                // a data flit of the current block was lost, the rest
+                // of it is replaced and the block counted
+                core.fill = core.left;
+                core.left = 0;
+                lost++;
+            }
+            if (core.fill == 0 && header_block == core.block) {
+                core.left = header_length;
+            } else if (header_block > core.block) {
+                // the blocks up to it are replaced first
+                core.pending = true;
+                core.pending_block = header_block;
+                core.pending_length = header_length;
+            }
+        } else if (core.left > 0) {
+            core.data = flit.data;
+            core.last = flit.last;
+            core.valid = true;
+            core.left--;
+            if (core.left == 0) {
+                core.block++;
+            }
+        }
+        // other flits are skipped until the next header
+        return true;
+    } else {
+        waiting = true;
+    }
+    return false;
+}
+
+extern "C"
+{
+    // flits is the number of flits of BOND_WIDTH bits
+    void stripe(
+        hls::stream<ap_axiu<BOND_WIDTH, 0, 0, 0>> &data_input,
+        hls::stream<ap_axiu<DATA_WIDTH, 0, 0, 0>> &data_output_0,
+        hls::stream<ap_axiu<DATA_WIDTH, 0, 0, 0>> &data_output_1,
+        unsigned int flits
+    ) {
+        unsigned int block = 0;
+        unsigned int left = 0;
+    stripe_flits:
+        for (unsigned int i = 0; i < flits;) {
+#pragma HLS PIPELINE II = 1
+            ap_axiu<DATA_WIDTH, 0, 0, 0> flit_0, flit_1;
+            if (left == 0) {
+                left = bond_block_length(block, flits);
+                flit_0.data = bond_header(block, left);
+                flit_0.last = 0;
+                flit_1.data = flit_0.data;
+                flit_1.last = 0;
+            } else {
+                ap_axiu<BOND_WIDTH, 0, 0, 0> flit = data_input.read();
+                flit_0.data = flit.data.range(DATA_WIDTH - 1, 0);
+                flit_0.last = flit.last;
+                flit_1.data = flit.data.range(BOND_WIDTH - 1, DATA_WIDTH);
+                flit_1.last = flit.last;
+                i++;
+                left--;
+                if (left == 0) {
+                    block++;
+                }
+            }
+            flit_0.keep = -1;
+            flit_1.keep = -1;
+            data_output_0.write(flit_0);
+            data_output_1.write(flit_1);
+        }
+    }
+
+    // swapped is set if the lower halves arrive on core 1, when core 0
+    // is cabled to core 1 of the sender. timeout 0 waits forever. errors
+    // is set to the number of blocks that were replaced by zeros on both
+    // cores
+    void merge(
+        hls::stream<ap_axiu<DATA_WIDTH, 0, 0, 0>> &data_input_0,
+        hls::stream<ap_axiu<DATA_WIDTH, 0, 0, 0>> &data_input_1,
+        hls::stream<ap_axiu<BOND_WIDTH, 0, 0, 0>> &data_output,
+        unsigned int flits,
+        unsigned int swapped,
+        unsigned int timeout,
+        unsigned int *errors
+    ) {
+#pragma HLS INTERFACE m_axi port = errors bundle = errors
+        MergeCore core_0 = {0, 0, 0, false, 0, 0, false, 0, false};
+        MergeCore core_1 = {0, 0, 0, false, 0, 0, false, 0, false};
+        unsigned int lost = 0;
+        // cycles without input, counted after the first flit
+        unsigned int idle = 0;
+        bool started = false;
+        bool flush = false;
+    merge_flits:
+        for (unsigned int i = 0; i < flits;) {
+#pragma HLS PIPELINE II = 1
+            if (core_0.valid && core_1.valid) {
+                ap_axiu<BOND_WIDTH, 0, 0, 0> flit;
+                if (swapped != 0) {
+                    flit.data = (core_0.data, core_1.data);
+                } else {
+                    flit.data = (core_1.data, core_0.data);
+                }
+                flit.keep = -1;
+                flit.last = core_0.last || core_1.last;
+                data_output.write(flit);
+                i++;
+                core_0.valid = false;
+                core_1.valid = false;
+            }
+            bool waiting = false;
+            bool received_0 = merge_core(data_input_0, core_0, flits, flush, lost, waiting);
+            bool received_1 = merge_core(data_input_1, core_1, flits, flush, lost, waiting);
+            if (received_0 || received_1) {
+                started = true;
+                idle = 0;
+            } else if (waiting && started && timeout != 0 && !flush) {
+                idle++;
+                if (idle >= timeout) {
+                    flush = true;
+                    lost++;
+                }
+            }
+        }
+        *errors = lost;
+    }
+}
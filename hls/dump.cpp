@@ -27,6 +27,19 @@
 
 #define STREAM_DEPTH 256
 
+// bursts of 64 flits, 4 KiB at 512 bit, the largest burst allowed by AXI.
+// The flits of 1024 bit of the bonded design reach it with 32 flits
+#if DATA_WIDTH_BYTES > 64
+#define MAX_BURST_LENGTH 32
+#else
+#define MAX_BURST_LENGTH 64
+#endif
+
+// timestamps per iteration: cycles of the first and last flit
+#define DUMP_TIMESTAMPS 2
+
+#include "prng.hpp"
+
 extern "C"
 {
     void dump_data(
@@ -36,15 +49,34 @@ extern "C"
         hls::stream<ap_uint<DATA_WIDTH>, STREAM_DEPTH> &data_stream,
         unsigned int ack_mode,
         hls::stream<ap_axiu<1, 0, 0, 0>>& loopback_ack_stream,
-        hls::stream<ap_axiu<1, 0, 0, 0>>& pair_ack_stream
+        hls::stream<ap_axiu<1, 0, 0, 0>>& pair_ack_stream,
+        unsigned long long *timestamps
     ) {
+        // the streams are accessed without blocking, so the loop runs
+        // every cycle and counts the cycles since the start
+        unsigned long long cycles = 0;
     dump_iterations:
         for (unsigned int n = 0; n < iterations; n++) {
+            unsigned long long first = 0, last = 0;
+            ap_axiu<DATA_WIDTH, 0, 0, 0> temp;
+            bool valid = false;
         dump_chunks:
-            for (int i = 0; i < chunks; i++) {
+            for (int i = 0; i < chunks; cycles++) {
 #pragma HLS PIPELINE II = 1
-                data_stream.write(data_input.read().data);
+                if (!valid && data_input.read_nb(temp)) {
+                    if (i == 0) {
+                        first = cycles;
+                    }
+                    last = cycles;
+                    valid = true;
+                }
+                if (valid && data_stream.write_nb(temp.data)) {
+                    valid = false;
+                    i++;
+                }
             }
+            timestamps[DUMP_TIMESTAMPS * n] = first;
+            timestamps[DUMP_TIMESTAMPS * n + 1] = last;
             ap_axiu<1, 0, 0, 0> ack;
             if (ack_mode == 0) {
                 loopback_ack_stream.write(ack);
@@ -54,20 +86,59 @@ extern "C"
         }
     }
 
+    // writes the received data to memory or, if verify is set, compares
+    // it with the data generated from seed and only writes the number of
+    // mismatched bytes and the offset of the first one to the first flit
     void write_data(
         unsigned int iterations,
         unsigned int chunks,
         hls::stream<ap_uint<DATA_WIDTH>, STREAM_DEPTH> &data_stream,
-        ap_uint<DATA_WIDTH> *data_output
+        ap_uint<DATA_WIDTH> *data_output,
+        unsigned int verify,
+        unsigned long long seed
     ) {
-    write_iterations:
-        for (unsigned int n = 0; n < iterations; n++) {
-        write_chunks:
-            for (int i = 0; i < chunks; i++) {
+        unsigned int errors = 0;
+        unsigned int first_error = 0xffffffff;
+        // separate loops, so the writes are not conditional and are
+        // inferred as bursts
+        if (verify) {
+        verify_iterations:
+            for (unsigned int n = 0; n < iterations; n++) {
+            verify_chunks:
+                for (int i = 0; i < chunks; i++) {
+#pragma HLS PIPELINE II = 1
+                    ap_uint<DATA_WIDTH> diff = data_stream.read() ^ prng_flit(seed, i);
+                    unsigned int mismatched = 0;
+                    unsigned int first = 0;
+                    for (int b = DATA_WIDTH_BYTES - 1; b >= 0; b--) {
+#pragma HLS UNROLL
+                        if (diff.range(8 * b + 7, 8 * b) != 0) {
+                            mismatched++;
+                            first = b;
+                        }
+                    }
+                    if (mismatched != 0 && errors == 0) {
+                        first_error = i * DATA_WIDTH_BYTES + first;
+                    }
+                    errors += mismatched;
+                }
+            }
+        } else {
+        write_iterations:
+            for (unsigned int n = 0; n < iterations; n++) {
+            write_chunks:
+                for (int i = 0; i < chunks; i++) {
 #pragma HLS PIPELINE II = 1
-                data_output[i] = data_stream.read();
+                    data_output[i] = data_stream.read();
+                }
             }
         }
+        if (verify) {
+            ap_uint<DATA_WIDTH> result = 0;
+            result.range(31, 0) = errors;
+            result.range(63, 32) = first_error;
+            data_output[0] = result;
+        }
     }
 
     void dump(
@@ -77,14 +148,19 @@ extern "C"
         unsigned int iterations,
         unsigned int ack_mode,
         hls::stream<ap_axiu<1, 0, 0, 0>> &loopback_ack_stream,
-        hls::stream<ap_axiu<1, 0, 0, 0>> &pair_ack_stream
+        hls::stream<ap_axiu<1, 0, 0, 0>> &pair_ack_stream,
+        unsigned int verify,
+        unsigned long long seed,
+        unsigned long long *timestamps
     ) {
+#pragma HLS INTERFACE m_axi port = data_output bundle = gmem max_write_burst_length = MAX_BURST_LENGTH num_write_outstanding = 16
+#pragma HLS INTERFACE m_axi port = timestamps bundle = timestamps
 #pragma HLS dataflow
         int chunks = byte_size / DATA_WIDTH_BYTES;
         hls::stream<ap_uint<DATA_WIDTH>, STREAM_DEPTH> data_stream;
 
-        dump_data(iterations, chunks, data_input, data_stream, ack_mode, loopback_ack_stream, pair_ack_stream);
-        write_data(iterations, chunks, data_stream, data_output);
+        dump_data(iterations, chunks, data_input, data_stream, ack_mode, loopback_ack_stream, pair_ack_stream, timestamps);
+        write_data(iterations, chunks, data_stream, data_output, verify, seed);
     }
 }
 
@@ -27,20 +27,66 @@
 
 #define STREAM_DEPTH 256
 
+// bursts of 64 flits, 4 KiB at 512 bit, the largest burst allowed by AXI.
+// The flits of 1024 bit of the bonded design reach it with 32 flits
+#if DATA_WIDTH_BYTES > 64
+#define MAX_BURST_LENGTH 32
+#else
+#define MAX_BURST_LENGTH 64
+#endif
+
+// with the cache enabled, messages of up to this number of flits are read
+// from memory only once and repeated from the cache in all following iterations
+#ifndef CACHE_FLITS
+#define CACHE_FLITS 4096
+#endif
+
+// timestamps per iteration: cycles of the first and last flit and of the acknowledgement
+#define ISSUE_TIMESTAMPS 3
+
+#include "prng.hpp"
+
 extern "C"
 {
+    // reads the data from memory or, if generate is set, generates
+    // the same data from seed without accessing memory. If cache is set,
+    // messages that fit into the cache are only read in the first iteration
     void read_data(
         unsigned int iterations,
         unsigned int chunks,
         ap_uint<DATA_WIDTH> *data_input,
-        hls::stream<ap_uint<DATA_WIDTH>, STREAM_DEPTH> &data_stream
+        hls::stream<ap_uint<DATA_WIDTH>, STREAM_DEPTH> &data_stream,
+        unsigned int generate,
+        unsigned long long seed,
+        unsigned int cache
     ) {
+        ap_uint<DATA_WIDTH> cache_data[CACHE_FLITS];
+#pragma HLS BIND_STORAGE variable = cache_data type = ram_2p impl = uram
+        bool cached = cache && (chunks <= CACHE_FLITS);
     read_iterations:
         for (unsigned int n = 0; n < iterations; n++) {
-        read_chunks:
-            for (unsigned int i = 0; i < chunks; i++) {
-                #pragma HLS PIPELINE II = 1
-                data_stream.write(data_input[i]);
+            // separate loops without conditional memory accesses, so
+            // the reads are inferred as bursts
+            if (generate) {
+            generate_chunks:
+                for (unsigned int i = 0; i < chunks; i++) {
+                    #pragma HLS PIPELINE II = 1
+                    data_stream.write(prng_flit(seed, i));
+                }
+            } else if (n > 0 && cached) {
+            cached_chunks:
+                for (unsigned int i = 0; i < chunks; i++) {
+                    #pragma HLS PIPELINE II = 1
+                    data_stream.write(cache_data[i]);
+                }
+            } else {
+            read_chunks:
+                for (unsigned int i = 0; i < chunks; i++) {
+                    #pragma HLS PIPELINE II = 1
+                    ap_uint<DATA_WIDTH> data = data_input[i];
+                    cache_data[i % CACHE_FLITS] = data;
+                    data_stream.write(data);
+                }
             }
         }
     }
@@ -53,26 +99,49 @@ extern "C"
         hls::stream<ap_axiu<DATA_WIDTH, 0, 0, 0>> &data_output,
         unsigned int ack_mode,
         hls::stream<ap_axiu<1, 0, 0, 0>> &loopback_ack_stream,
-        hls::stream<ap_axiu<1, 0, 0, 0>> &pair_ack_stream
+        hls::stream<ap_axiu<1, 0, 0, 0>> &pair_ack_stream,
+        unsigned long long *timestamps
     ) {
+        // all streams are accessed without blocking, so the loops run
+        // every cycle and count the cycles since the start
+        unsigned long long cycles = 0;
     issue_iterations:
         for (unsigned int n = 0; n < iterations; n++) {
+            unsigned long long first = 0, last = 0;
+            ap_axiu<DATA_WIDTH, 0, 0, 0> temp;
+            bool valid = false;
         issue_chunks:
-            for (unsigned int i = 0; i < chunks; i++) {
+            for (unsigned int i = 0; i < chunks; cycles++) {
                 #pragma HLS PIPELINE II = 1
-                ap_axiu<DATA_WIDTH, 0, 0, 0> temp;
-                temp.data = data_stream.read();
-                if (frame_size != 0) {
-                    temp.last = (((i + 1) % frame_size) == 0) || ((i + 1) == chunks);
-                    temp.keep = -1;
+                ap_uint<DATA_WIDTH> data;
+                if (!valid && data_stream.read_nb(data)) {
+                    temp.data = data;
+                    if (frame_size != 0) {
+                        temp.last = (((i + 1) % frame_size) == 0) || ((i + 1) == chunks);
+                        temp.keep = -1;
+                    }
+                    valid = true;
+                }
+                if (valid && data_output.write_nb(temp)) {
+                    if (i == 0) {
+                        first = cycles;
+                    }
+                    last = cycles;
+                    valid = false;
+                    i++;
                 }
-                data_output.write(temp);
             }
-            if (ack_mode == 0) {
-                ap_axiu<1, 0, 0, 0> ack = loopback_ack_stream.read();
-            } else if (ack_mode == 1) {
-                ap_axiu<1, 0, 0, 0> ack = pair_ack_stream.read();
+            bool acked = (ack_mode > 1);
+        ack_wait:
+            while (!acked) {
+                #pragma HLS PIPELINE II = 1
+                cycles++;
+                ap_axiu<1, 0, 0, 0> ack;
+                acked = (ack_mode == 0) ? loopback_ack_stream.read_nb(ack) : pair_ack_stream.read_nb(ack);
             }
+            timestamps[ISSUE_TIMESTAMPS * n] = first;
+            timestamps[ISSUE_TIMESTAMPS * n + 1] = last;
+            timestamps[ISSUE_TIMESTAMPS * n + 2] = (ack_mode > 1) ? 0 : cycles;
         }
     }
 
@@ -84,13 +153,19 @@ extern "C"
         unsigned int iterations,
         unsigned int ack_mode,
         hls::stream<ap_axiu<1, 0, 0, 0>>& loopback_ack_stream,
-        hls::stream<ap_axiu<1, 0, 0, 0>>& pair_ack_stream
+        hls::stream<ap_axiu<1, 0, 0, 0>>& pair_ack_stream,
+        unsigned int generate,
+        unsigned long long seed,
+        unsigned int cache,
+        unsigned long long *timestamps
     ) {
+#pragma HLS INTERFACE m_axi port = data_input bundle = gmem max_read_burst_length = MAX_BURST_LENGTH num_read_outstanding = 16
+#pragma HLS INTERFACE m_axi port = timestamps bundle = timestamps
 #pragma HLS dataflow
         unsigned int chunks = byte_size / DATA_WIDTH_BYTES;
         hls::stream<ap_uint<DATA_WIDTH>, STREAM_DEPTH> data_stream;
 
-        read_data(iterations, chunks, data_input, data_stream);
-        issue_data(iterations, chunks, frame_size, data_stream, data_output, ack_mode, loopback_ack_stream, pair_ack_stream);
+        read_data(iterations, chunks, data_input, data_stream, generate, seed, cache);
+        issue_data(iterations, chunks, frame_size, data_stream, data_output, ack_mode, loopback_ack_stream, pair_ack_stream, timestamps);
     }
 }
@@ -0,0 +1,240 @@
+/*
+ * Copyright 2023-2024 Gerrit Pape (papeg@mail.upb.de)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// C simulation of the issue and dump kernels connected back to back.
+// The cache is made small, so messages are tested with and without it.
+#define CACHE_FLITS 16
+
+#include "issue.cpp"
+#include "dump.cpp"
+#include "bond.cpp"
+
+#include <cstdio>
+#include <vector>
+
+// without acknowledgements, so issue can run to completion before dump
+#define NO_ACK 2
+
+// connection of issue and dump: directly, striped over two channels and
+// striped over two crossed channels, like a loopback between both cores
+#define DIRECT 0
+#define BONDED 1
+#define BONDED_CROSSED 2
+
+// cycles merge waits for missing flits, all data is there in the C simulation
+#define MERGE_TIMEOUT 100
+
+unsigned int failures = 0;
+
+void check(bool condition, const char *test, unsigned int chunks, unsigned int iterations)
+{
+    if (!condition) {
+        printf("FAIL: %s with %u chunks and %u iterations\n", test, chunks, iterations);
+        failures++;
+    }
+}
+
+std::vector<ap_uint<DATA_WIDTH>> generate(unsigned int chunks, unsigned long long seed)
+{
+    std::vector<ap_uint<DATA_WIDTH>> data(chunks);
+    for (unsigned int i = 0; i < chunks; i++) {
+        data[i] = prng_flit(seed, i);
+    }
+    return data;
+}
+
+struct Transfer
+{
+    std::vector<ap_uint<DATA_WIDTH>> output;
+    unsigned int flits = 0;
+    unsigned int frames = 0;
+    unsigned int errors = 0;
+    unsigned int first_error = 0;
+    unsigned int bond_errors = 0;
+    std::vector<unsigned long long> issue_timestamps;
+    std::vector<unsigned long long> dump_timestamps;
+};
+
+Transfer transfer(std::vector<ap_uint<DATA_WIDTH>> &input, unsigned int chunks, unsigned int frame_size, unsigned int iterations,
+                  unsigned int generate, unsigned long long issue_seed, unsigned int verify, unsigned long long dump_seed,
+                  unsigned int connection = DIRECT, int drop = -1, unsigned int cache = 0)
+{
+    hls::stream<ap_axiu<DATA_WIDTH, 0, 0, 0>> link, checked_link, channel_0, channel_1;
+    hls::stream<ap_axiu<1, 0, 0, 0>> loopback_ack_stream, pair_ack_stream;
+    Transfer result;
+    result.output.resize(chunks);
+    result.issue_timestamps.resize(ISSUE_TIMESTAMPS * iterations);
+    result.dump_timestamps.resize(DUMP_TIMESTAMPS * iterations);
+
+    if (connection == DIRECT) {
+        issue(link, input.data(), chunks * DATA_WIDTH_BYTES, frame_size, iterations, NO_ACK, loopback_ack_stream, pair_ack_stream, generate, issue_seed, cache, result.issue_timestamps.data());
+    } else {
+        // the issue and dump kernels of the bonded design have flits of
+        // BOND_WIDTH bits, here two flits of issue form one of stripe
+        hls::stream<ap_axiu<DATA_WIDTH, 0, 0, 0>> issued;
+        hls::stream<ap_axiu<BOND_WIDTH, 0, 0, 0>> striped, merged;
+        issue(issued, input.data(), chunks * DATA_WIDTH_BYTES, frame_size, iterations, NO_ACK, loopback_ack_stream, pair_ack_stream, generate, issue_seed, cache, result.issue_timestamps.data());
+        while (!issued.empty()) {
+            ap_axiu<DATA_WIDTH, 0, 0, 0> low = issued.read();
+            ap_axiu<DATA_WIDTH, 0, 0, 0> high = issued.read();
+            ap_axiu<BOND_WIDTH, 0, 0, 0> flit;
+            flit.data = (high.data, low.data);
+            flit.last = high.last;
+            striped.write(flit);
+        }
+        unsigned int flits = chunks * iterations / 2;
+        stripe(striped, channel_0, channel_1, flits);
+        if (drop >= 0 && drop < (int)channel_1.size()) {
+            // lose a flit on the second channel
+            hls::stream<ap_axiu<DATA_WIDTH, 0, 0, 0>> lossy;
+            for (int i = 0; !channel_1.empty(); i++) {
+                ap_axiu<DATA_WIDTH, 0, 0, 0> flit = channel_1.read();
+                if (i != drop) {
+                    lossy.write(flit);
+                }
+            }
+            while (!lossy.empty()) {
+                channel_1.write(lossy.read());
+            }
+        }
+        if (connection == BONDED) {
+            merge(channel_0, channel_1, merged, flits, 0, MERGE_TIMEOUT, &result.bond_errors);
+        } else {
+            merge(channel_1, channel_0, merged, flits, 1, MERGE_TIMEOUT, &result.bond_errors);
+        }
+        while (!merged.empty()) {
+            ap_axiu<BOND_WIDTH, 0, 0, 0> flit = merged.read();
+            ap_axiu<DATA_WIDTH, 0, 0, 0> low, high;
+            low.data = flit.data.range(DATA_WIDTH - 1, 0);
+            low.last = 0;
+            high.data = flit.data.range(BOND_WIDTH - 1, DATA_WIDTH);
+            high.last = flit.last;
+            link.write(low);
+            link.write(high);
+        }
+    }
+
+    while (!link.empty()) {
+        ap_axiu<DATA_WIDTH, 0, 0, 0> flit = link.read();
+        result.flits++;
+        if (frame_size != 0 && flit.last) {
+            result.frames++;
+        }
+        checked_link.write(flit);
+    }
+
+    dump(checked_link, result.output.data(), chunks * DATA_WIDTH_BYTES, iterations, NO_ACK, loopback_ack_stream, pair_ack_stream, verify, dump_seed, result.dump_timestamps.data());
+
+    if (verify) {
+        result.errors = result.output[0].range(31, 0).to_uint();
+        result.first_error = result.output[0].range(63, 32).to_uint();
+    }
+    return result;
+}
+
+int main()
+{
+    const unsigned long long seed = 7;
+    const unsigned int chunk_counts[] = {1, 2, 3, 7, 15, 16, 17, 33, 34, 200};
+    const unsigned int iteration_counts[] = {1, 3};
+
+    for (unsigned int chunks: chunk_counts) {
+        for (unsigned int iterations: iteration_counts) {
+            std::vector<ap_uint<DATA_WIDTH>> input = generate(chunks, seed);
+
+            // memory to memory, with odd frame sizes
+            Transfer t = transfer(input, chunks, 3, iterations, 0, 0, 0, 0);
+            check(t.flits == chunks * iterations, "number of flits", chunks, iterations);
+            check(t.frames == ((chunks + 2) / 3) * iterations, "number of frames", chunks, iterations);
+            bool equal = true;
+            for (unsigned int i = 0; i < chunks; i++) {
+                equal = equal && (t.output[i] == input[i]);
+            }
+            check(equal, "memory to memory", chunks, iterations);
+
+            // repeated from the cache, only if the message fits
+            t = transfer(input, chunks, 3, iterations, 0, 0, 1, seed, DIRECT, -1, 1);
+            check(t.flits == chunks * iterations && t.errors == 0, "cache to sink", chunks, iterations);
+
+            // without back pressure, both kernels handle one flit per cycle
+            bool timestamps_ok = true;
+            for (unsigned int n = 0; n < iterations; n++) {
+                timestamps_ok = timestamps_ok
+                    && (t.issue_timestamps[ISSUE_TIMESTAMPS * n + 1] - t.issue_timestamps[ISSUE_TIMESTAMPS * n] == chunks - 1)
+                    && (t.issue_timestamps[ISSUE_TIMESTAMPS * n + 2] == 0)
+                    && (t.dump_timestamps[DUMP_TIMESTAMPS * n + 1] - t.dump_timestamps[DUMP_TIMESTAMPS * n] == chunks - 1);
+            }
+            check(timestamps_ok, "timestamps", chunks, iterations);
+
+            // generated on chip and verified on chip
+            t = transfer(input, chunks, 0, iterations, 1, seed, 1, seed);
+            check(t.errors == 0 && t.first_error == 0xffffffff, "stream", chunks, iterations);
+
+            // memory to on chip verification
+            t = transfer(input, chunks, 0, iterations, 0, 0, 1, seed);
+            check(t.errors == 0, "memory to sink", chunks, iterations);
+
+            // a single corrupted byte is found in every iteration
+            unsigned int flit = chunks / 2;
+            ap_uint<DATA_WIDTH> flip = 1;
+            input[flit] ^= flip << 40;
+            t = transfer(input, chunks, 0, iterations, 0, 0, 1, seed);
+            check(t.errors == iterations, "number of errors", chunks, iterations);
+            check(t.first_error == flit * DATA_WIDTH_BYTES + 5, "offset of the first error", chunks, iterations);
+            t = transfer(input, chunks, 0, iterations, 0, 0, 1, seed, DIRECT, -1, 1);
+            check(t.errors == iterations, "number of errors from the cache", chunks, iterations);
+
+            // striped over both channels, in pairs of flits
+            if (chunks % 2 == 0) {
+                t = transfer(input, chunks, 4, iterations, 0, 0, 0, 0, BONDED);
+                check(t.flits == chunks * iterations && t.frames == ((chunks + 3) / 4) * iterations, "bonded number of flits", chunks, iterations);
+                t = transfer(input, chunks, 0, iterations, 0, 0, 1, seed, BONDED);
+                check(t.errors == iterations && t.bond_errors == 0, "bonded", chunks, iterations);
+                t = transfer(input, chunks, 0, iterations, 1, seed, 1, seed, BONDED_CROSSED);
+                check(t.errors == 0 && t.bond_errors == 0, "bonded crossed", chunks, iterations);
+            }
+
+            // data of another sender
+            t = transfer(input, chunks, 0, iterations, 1, seed + 1, 1, seed);
+            check(t.errors > 0 && t.first_error < DATA_WIDTH_BYTES, "wrong seed", chunks, iterations);
+        }
+    }
+
+    // a flit lost in block 1 of 10 on the second channel: the header of
+    // block 2 arrives while one flit of block 1 is still expected, so merge
+    // replaces it and counts block 1 as lost. The later blocks, and so the
+    // last iteration in memory, arrive intact
+    const unsigned int chunks = 400;
+    const unsigned int iterations = 3;
+    std::vector<ap_uint<DATA_WIDTH>> input = generate(chunks, seed);
+    Transfer t = transfer(input, chunks, 0, iterations, 0, 0, 0, 0, BONDED, BOND_BLOCK + 11);
+    check(t.flits == chunks * iterations && t.bond_errors == 1, "bonded lost flit", chunks, iterations);
+    bool equal = true;
+    for (unsigned int i = 0; i < chunks; i++) {
+        equal = equal && (t.output[i] == input[i]);
+    }
+    check(equal, "bonded resync", chunks, iterations);
+    // lost in the last block of the second channel, merge times out
+    t = transfer(input, chunks, 0, iterations, 0, 0, 0, 0, BONDED, 9 * (BOND_BLOCK + 1) + 1);
+    check(t.flits == chunks * iterations && t.bond_errors == 1, "bonded timeout", chunks, iterations);
+
+    if (failures) {
+        printf("%u tests FAILED\n", failures);
+        return 1;
+    }
+    printf("all tests PASSED\n");
+    return 0;
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright 2023-2024 Gerrit Pape (papeg@mail.upb.de)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// Generator of the test data, shared by the host and the HLS kernels.
+// Every 64 bit word of a message only depends on the seed and the index
+// of the word, so the receiver can regenerate the expected data at any
+// offset without state. The words are stored in little endian order,
+// which matches the byte order of ap_uint in host memory.
+// In the kernels every word costs three 64 bit multiplications by a
+// constant, so a flit of 8 words needs 24 multipliers per pipeline. If
+// HLS maps them to DSPs, that is in the order of ten DSP48E2 each, so
+// generating and checking on the device adds a few hundred DSPs to issue
+// and to dump.
+static inline uint64_t prng_word(uint64_t seed, uint64_t index)
+{
+    // splitmix64 of the counter
+    uint64_t z = seed + (index + 1) * 0x9e3779b97f4a7c15ull;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+#ifdef DATA_WIDTH
+// flit i of a message, only available in the kernels, which define DATA_WIDTH
+static inline ap_uint<DATA_WIDTH> prng_flit(uint64_t seed, unsigned int i)
+{
+#pragma HLS INLINE
+    ap_uint<DATA_WIDTH> flit;
+    for (unsigned int w = 0; w < DATA_WIDTH / 64; w++) {
+#pragma HLS UNROLL
+        flit.range(64 * w + 63, 64 * w) = prng_word(seed, (uint64_t)i * (DATA_WIDTH / 64) + w);
+    }
+    return flit;
+}
+#endif
@@ -18,8 +18,14 @@
 
 #include "experimental/xrt_kernel.h"
 #include "experimental/xrt_ip.h"
+#include <algorithm>
 #include <cmath>
 #include <bitset>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
 
 double get_wtime()
 {
@@ -58,6 +64,27 @@ static const uint32_t SOFT_ERR_COUNT_ADDRESS          = 0x00000074;
 static const uint32_t CHANNEL_DOWN_COUNT_ADDRESS      = 0x00000078;
 static const uint32_t FRAMES_RECEIVED_ADDRESS         = 0x0000007c;
 static const uint32_t FRAMES_WITH_ERRORS_ADDRESS      = 0x00000080;
+static const uint32_t TX_STALL_COUNT_ADDRESS          = 0x00000084;
+static const uint32_t RX_STALL_COUNT_ADDRESS          = 0x00000088;
+static const uint32_t NFC_XOFF_COUNT_ADDRESS          = 0x0000008c;
+static const uint32_t IDLE_COUNT_ADDRESS              = 0x00000090;
+static const uint32_t NFC_THRESHOLDS_ADDRESS          = 0x00000094;
+static const uint32_t NFC_MODE_ADDRESS                = 0x00000098;
+static const uint32_t NFC_PAUSE_QUANTA_ADDRESS        = 0x000000a0;
+static const uint32_t NFC_PAUSE_QUANTA                = 4;
+// a write latches the 64 bit counters below, low word first
+static const uint32_t SNAPSHOT_ADDRESS                = 0x000000b0;
+static const uint32_t SNAPSHOT_CYCLE_COUNT_ADDRESS    = 0x000000b8;
+static const uint32_t SNAPSHOT_TX_COUNT_ADDRESS       = 0x000000c0;
+static const uint32_t SNAPSHOT_RX_COUNT_ADDRESS       = 0x000000c8;
+static const uint32_t SNAPSHOT_TX_BYTES_ADDRESS       = 0x000000d0;
+static const uint32_t SNAPSHOT_RX_BYTES_ADDRESS       = 0x000000d8;
+static const uint32_t NFC_LATENCY_HISTOGRAM_ADDRESS   = 0x00000100;
+static const uint32_t FIFO_RX_FILL_HISTOGRAM_ADDRESS  = 0x00000140;
+
+// bins of the log2 histograms of aurora_flow_nfc, bin 0 counts the zeros,
+// bin b > 0 the values from 2^(b - 1) to 2^b - 1 and the last bin all above
+static const uint32_t HISTOGRAM_BINS = 16;
 
 // masks for core status bits
 static const uint32_t GT_POWERGOOD    = 0x0000000f;
@@ -104,13 +131,171 @@ static const char *rx_eq_mode_names[4] = {
     ""
 };
 
+// access to the registers of an Aurora core
+class AuroraRegisters
+{
+public:
+    virtual ~AuroraRegisters() {}
+
+    virtual uint32_t read_register(uint32_t offset) = 0;
+
+    virtual void write_register(uint32_t offset, uint32_t data) = 0;
+};
+
+// registers of an Aurora core on the FPGA
+class XrtAuroraRegisters : public AuroraRegisters
+{
+public:
+    XrtAuroraRegisters(xrt::ip ip) : ip(ip) {}
+
+    uint32_t read_register(uint32_t offset) override
+    {
+        return ip.read_register(offset);
+    }
+
+    void write_register(uint32_t offset, uint32_t data) override
+    {
+        ip.write_register(offset, data);
+    }
+
+private:
+    xrt::ip ip;
+};
+
+// software model of the address map of aurora_flow_control_s_axi.
+// The core is always up. The counters stay zero unless they are fed by
+// an emulated core, see connect()
+class EmulatedAuroraRegisters : public AuroraRegisters
+{
+public:
+    EmulatedAuroraRegisters(uint32_t fifo_width = 64, bool framing = false, uint32_t fifo_depth = 1024,
+                            uint32_t fifo_prog_full = 512, uint32_t fifo_prog_empty = 128)
+        : fifo_width(fifo_width), counter_start(std::chrono::steady_clock::now())
+    {
+        registers[CONFIGURATION_ADDRESS] = (framing ? (HAS_TKEEP | HAS_TLAST) : 0)
+                                         | ((fifo_width << 2) & FIFO_WIDTH)
+                                         | (((uint32_t)log2(fifo_depth) << 11) & FIFO_DEPTH);
+        registers[FIFO_THRESHOLDS_ADDRESS] = (fifo_prog_full << 16) | (fifo_prog_empty & 0xffff);
+        registers[NFC_THRESHOLDS_ADDRESS] = registers[FIFO_THRESHOLDS_ADDRESS];
+        registers[NFC_MODE_ADDRESS] = 4 << 8;
+        for (uint32_t i = 0; i < NFC_PAUSE_QUANTA; i++) {
+            registers[NFC_PAUSE_QUANTA_ADDRESS + 4 * i] = 32 << i;
+        }
+        registers[CORE_STATUS_ADDRESS] = CORE_STATUS_OK;
+        registers[FIFO_STATUS_ADDRESS] = FIFO_TX_PROG_EMPTY | FIFO_TX_ALMOST_EMPTY
+                                       | FIFO_RX_PROG_EMPTY | FIFO_RX_ALMOST_EMPTY;
+    }
+
+    // feed the counters from an emulated core with the getters of
+    // AuroraEmuEndpoint and start them at zero. The core is referenced,
+    // so it has to outlive this register file and the Aurora objects
+    // sharing it
+    template <typename Core>
+    void connect(Core &core)
+    {
+        source = [&core](uint32_t offset) -> uint64_t {
+            switch (offset) {
+            case FIFO_RX_OVERFLOW_COUNT_ADDRESS: return core.get_fifo_rx_overflow_count();
+            case NFC_FULL_TRIGGER_COUNT_ADDRESS: return core.get_nfc_full_trigger_count();
+            case NFC_EMPTY_TRIGGER_COUNT_ADDRESS: return core.get_nfc_empty_trigger_count();
+            case NFC_LATENCY_COUNT_ADDRESS: return core.get_nfc_latency_count();
+            case TX_COUNT_ADDRESS: return core.get_tx_count();
+            case RX_COUNT_ADDRESS: return core.get_rx_count();
+            case LINE_DOWN_0_COUNT_ADDRESS: return core.get_line_down_0_count();
+            case LINE_DOWN_1_COUNT_ADDRESS: return core.get_line_down_1_count();
+            case LINE_DOWN_2_COUNT_ADDRESS: return core.get_line_down_2_count();
+            case LINE_DOWN_3_COUNT_ADDRESS: return core.get_line_down_3_count();
+            case HARD_ERR_COUNT_ADDRESS: return core.get_hard_err_count();
+            case SOFT_ERR_COUNT_ADDRESS: return core.get_soft_err_count();
+            case CHANNEL_DOWN_COUNT_ADDRESS: return core.get_channel_down_count();
+            case FRAMES_RECEIVED_ADDRESS: return core.get_frames_received();
+            case FRAMES_WITH_ERRORS_ADDRESS: return core.get_frames_with_errors();
+            default: return 0;
+            }
+        };
+        reset_counter();
+    }
+
+    uint32_t read_register(uint32_t offset) override
+    {
+        if (is_counter(offset)) {
+            // the counters of the emulated core are never reset, so the
+            // register reads the difference to the last reset
+            return counter(offset);
+        }
+        return registers[offset];
+    }
+
+    void write_register(uint32_t offset, uint32_t data) override
+    {
+        if (offset == COUNTER_RESET_ADDRESS && data) {
+            reset_counter();
+        }
+        if (offset == SNAPSHOT_ADDRESS && (data & 1)) {
+            snapshot();
+        }
+        registers[offset] = data;
+    }
+
+    // clock of the cycle counter, the kernels run at 300 MHz by default
+    static constexpr double CYCLES_PER_SECOND = 300e6;
+
+private:
+    uint32_t fifo_width;
+    std::chrono::steady_clock::time_point counter_start;
+    std::map<uint32_t, uint32_t> registers;
+    std::map<uint32_t, uint64_t> counter_offsets;
+    std::function<uint64_t(uint32_t)> source;
+
+    uint64_t counter(uint32_t offset)
+    {
+        return (source ? source(offset) : 0) - counter_offsets[offset];
+    }
+
+    void set_snapshot(uint32_t offset, uint64_t value)
+    {
+        registers[offset] = (uint32_t)value;
+        registers[offset + 4] = (uint32_t)(value >> 32);
+    }
+
+    // the emulated cores move whole flits and have no clock, so the bytes
+    // are the flits times the FIFO width and the cycles the elapsed time
+    void snapshot()
+    {
+        uint64_t tx_count = counter(TX_COUNT_ADDRESS);
+        uint64_t rx_count = counter(RX_COUNT_ADDRESS);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - counter_start).count();
+        set_snapshot(SNAPSHOT_CYCLE_COUNT_ADDRESS, (uint64_t)(seconds * CYCLES_PER_SECOND));
+        set_snapshot(SNAPSHOT_TX_COUNT_ADDRESS, tx_count);
+        set_snapshot(SNAPSHOT_RX_COUNT_ADDRESS, rx_count);
+        set_snapshot(SNAPSHOT_TX_BYTES_ADDRESS, tx_count * fifo_width);
+        set_snapshot(SNAPSHOT_RX_BYTES_ADDRESS, rx_count * fifo_width);
+    }
+
+    static bool is_counter(uint32_t offset)
+    {
+        return (offset >= STATUS_NOT_OK_COUNT_ADDRESS) && (offset <= IDLE_COUNT_ADDRESS)
+            && (offset != FIFO_STATUS_ADDRESS);
+    }
+
+    void reset_counter()
+    {
+        for (uint32_t offset = STATUS_NOT_OK_COUNT_ADDRESS; offset <= IDLE_COUNT_ADDRESS; offset += 4) {
+            if (is_counter(offset)) {
+                counter_offsets[offset] = source ? source(offset) : 0;
+            }
+        }
+        counter_start = std::chrono::steady_clock::now();
+    }
+};
+
 class Aurora
 {
 public:
-    Aurora(xrt::ip ip) : ip(ip)
+    Aurora(std::shared_ptr<AuroraRegisters> registers) : registers(registers)
     {
         // read constant configuration information
-        uint32_t configuration = ip.read_register(CONFIGURATION_ADDRESS);
+        uint32_t configuration = registers->read_register(CONFIGURATION_ADDRESS);
 
         has_tkeep = (configuration & HAS_TKEEP);
         has_tlast = (configuration & HAS_TLAST) >> 1;
@@ -119,12 +304,14 @@ public:
         rx_eq_mode = (configuration & RX_EQ_MODE_BINARY) >> 15; 
         ins_loss_nyq = (configuration & INS_LOSS_NYQ) >> 17;
 
-        uint32_t fifo_thresholds = ip.read_register(FIFO_THRESHOLDS_ADDRESS);
+        uint32_t fifo_thresholds = registers->read_register(FIFO_THRESHOLDS_ADDRESS);
 
         fifo_prog_full_threshold = (fifo_thresholds & 0xffff0000) >> 16;
         fifo_prog_empty_threshold = (fifo_thresholds & 0x0000ffff);
     }
 
+    Aurora(xrt::ip ip) : Aurora(std::make_shared<XrtAuroraRegisters>(ip)) {}
+
     Aurora(std::string name, xrt::device &device, xrt::uuid &xclbin_uuid)
         : Aurora(xrt::ip(device, xclbin_uuid, name)) {}
 
@@ -154,7 +341,7 @@ public:
 
     uint32_t get_configuration()
     {
-        return ip.read_register(CONFIGURATION_ADDRESS);
+        return registers->read_register(CONFIGURATION_ADDRESS);
     }
 
     void print_configuration()
@@ -166,15 +353,77 @@ public:
         std::cout << "FIFO depth: " << fifo_depth << std::endl;
         std::cout << "FIFO full threshold: " << fifo_prog_full_threshold << std::endl;
         std::cout << "FIFO empty threshold: " << fifo_prog_empty_threshold << std::endl;
+        std::cout << "NFC thresholds: " << get_nfc_full_threshold() << " " << get_nfc_empty_threshold() << std::endl;
+        if (get_nfc_pause_mode()) {
+            std::cout << "NFC pause quanta:";
+            for (uint32_t i = 0; i < NFC_PAUSE_QUANTA; i++) {
+                std::cout << " " << get_nfc_pause_quantum(i);
+            }
+            std::cout << " every " << (1u << get_nfc_pause_step()) << " flits" << std::endl;
+        }
         std::cout << "Equalization mode: " << rx_eq_mode_names[rx_eq_mode] << std::endl;
         std::cout << "Nyquist loss: " << (uint16_t)ins_loss_nyq << std::endl;
     }
 
+    // Flow control
+
+    // fill levels of the rx fifo in flits, at which XOFF and XON are sent.
+    // They default to the prog full and prog empty thresholds of the fifo
+    void set_nfc_thresholds(uint16_t full, uint16_t empty)
+    {
+        registers->write_register(NFC_THRESHOLDS_ADDRESS, ((uint32_t)full << 16) | empty);
+    }
+
+    uint16_t get_nfc_full_threshold()
+    {
+        return (registers->read_register(NFC_THRESHOLDS_ADDRESS) & 0xffff0000) >> 16;
+    }
+
+    uint16_t get_nfc_empty_threshold()
+    {
+        return (registers->read_register(NFC_THRESHOLDS_ADDRESS) & 0x0000ffff);
+    }
+
+    // instead of XOFF, the partner is paused for a number of cycles. The
+    // quantum is chosen by the fill level above the full threshold in steps
+    // of 2^step flits, the pause is refreshed while the fifo stays full.
+    // The quanta are clamped to 2 to 0xfffe: 0 and 0xffff are XON and XOFF
+    // and below 2 the refresh after half of the pause would resend it
+    // every few cycles
+    void set_nfc_pause_mode(uint8_t step, const std::vector<uint16_t> &quanta)
+    {
+        for (uint32_t i = 0; i < NFC_PAUSE_QUANTA && i < quanta.size(); i++) {
+            uint16_t quantum = std::min(std::max(quanta[i], (uint16_t)2), (uint16_t)0xfffe);
+            registers->write_register(NFC_PAUSE_QUANTA_ADDRESS + 4 * i, quantum);
+        }
+        registers->write_register(NFC_MODE_ADDRESS, ((uint32_t)(step & 0x1f) << 8) | 1);
+    }
+
+    void set_nfc_xoff_mode()
+    {
+        registers->write_register(NFC_MODE_ADDRESS, registers->read_register(NFC_MODE_ADDRESS) & ~1);
+    }
+
+    bool get_nfc_pause_mode()
+    {
+        return registers->read_register(NFC_MODE_ADDRESS) & 1;
+    }
+
+    uint8_t get_nfc_pause_step()
+    {
+        return (registers->read_register(NFC_MODE_ADDRESS) >> 8) & 0x1f;
+    }
+
+    uint16_t get_nfc_pause_quantum(uint32_t index)
+    {
+        return registers->read_register(NFC_PAUSE_QUANTA_ADDRESS + 4 * index) & 0xffff;
+    }
+
     // Current status signals
 
     uint32_t get_core_status()
     {
-        return ip.read_register(CORE_STATUS_ADDRESS);
+        return registers->read_register(CORE_STATUS_ADDRESS);
     }
 
     uint8_t gt_powergood()
@@ -257,7 +506,7 @@ public:
     }
     uint32_t get_fifo_status()
     {
-        return ip.read_register(FIFO_STATUS_ADDRESS);
+        return registers->read_register(FIFO_STATUS_ADDRESS);
     }
 
     bool fifo_tx_is_prog_empty()
@@ -314,108 +563,140 @@ public:
 
     uint32_t get_tx_count()
     {
-        return ip.read_register(TX_COUNT_ADDRESS);
+        return registers->read_register(TX_COUNT_ADDRESS);
     }
 
     uint32_t get_rx_count()
     {
-        return ip.read_register(RX_COUNT_ADDRESS);
+        return registers->read_register(RX_COUNT_ADDRESS);
+    }
+
+    // latches the 64 bit counters of flits, bytes and kernel clock cycles
+    // in the same cycle, so they can be read one after the other
+    void snapshot()
+    {
+        registers->write_register(SNAPSHOT_ADDRESS, 1);
+    }
+
+    uint64_t get_snapshot_cycle_count()
+    {
+        return read_register_64(SNAPSHOT_CYCLE_COUNT_ADDRESS);
+    }
+
+    uint64_t get_snapshot_tx_count()
+    {
+        return read_register_64(SNAPSHOT_TX_COUNT_ADDRESS);
+    }
+
+    uint64_t get_snapshot_rx_count()
+    {
+        return read_register_64(SNAPSHOT_RX_COUNT_ADDRESS);
+    }
+
+    uint64_t get_snapshot_tx_bytes()
+    {
+        return read_register_64(SNAPSHOT_TX_BYTES_ADDRESS);
+    }
+
+    uint64_t get_snapshot_rx_bytes()
+    {
+        return read_register_64(SNAPSHOT_RX_BYTES_ADDRESS);
     }
 
     uint32_t get_fifo_tx_overflow_count()
     {
-        return ip.read_register(FIFO_TX_OVERFLOW_COUNT_ADDRESS);
+        return registers->read_register(FIFO_TX_OVERFLOW_COUNT_ADDRESS);
     }
 
     uint32_t get_fifo_rx_overflow_count()
     {
-        return ip.read_register(FIFO_RX_OVERFLOW_COUNT_ADDRESS);
+        return registers->read_register(FIFO_RX_OVERFLOW_COUNT_ADDRESS);
     }
 
     uint32_t get_nfc_full_trigger_count()
     {
-        return ip.read_register(NFC_FULL_TRIGGER_COUNT_ADDRESS);
+        return registers->read_register(NFC_FULL_TRIGGER_COUNT_ADDRESS);
     }
 
     uint32_t get_nfc_empty_trigger_count()
     {
-        return ip.read_register(NFC_FULL_TRIGGER_COUNT_ADDRESS);
+        return registers->read_register(NFC_EMPTY_TRIGGER_COUNT_ADDRESS);
     }
 
     uint32_t get_nfc_latency_count()
     {
-        return ip.read_register(NFC_LATENCY_COUNT_ADDRESS);
+        return registers->read_register(NFC_LATENCY_COUNT_ADDRESS);
     }
 
     uint32_t get_gt_not_ready_0_count()
     {
-        return ip.read_register(GT_NOT_READY_0_COUNT_ADDRESS);
+        return registers->read_register(GT_NOT_READY_0_COUNT_ADDRESS);
     }
 
     uint32_t get_gt_not_ready_1_count()
     {
-        return ip.read_register(GT_NOT_READY_1_COUNT_ADDRESS);
+        return registers->read_register(GT_NOT_READY_1_COUNT_ADDRESS);
     }
 
     uint32_t get_gt_not_ready_2_count()
     {
-        return ip.read_register(GT_NOT_READY_2_COUNT_ADDRESS);
+        return registers->read_register(GT_NOT_READY_2_COUNT_ADDRESS);
     }
 
     uint32_t get_gt_not_ready_3_count()
     {
-        return ip.read_register(GT_NOT_READY_3_COUNT_ADDRESS);
+        return registers->read_register(GT_NOT_READY_3_COUNT_ADDRESS);
     }
 
     uint32_t get_line_down_0_count()
     {
-        return ip.read_register(LINE_DOWN_0_COUNT_ADDRESS);
+        return registers->read_register(LINE_DOWN_0_COUNT_ADDRESS);
     }
 
     uint32_t get_line_down_1_count()
     {
-        return ip.read_register(LINE_DOWN_1_COUNT_ADDRESS);
+        return registers->read_register(LINE_DOWN_1_COUNT_ADDRESS);
     }
 
     uint32_t get_line_down_2_count()
     {
-        return ip.read_register(LINE_DOWN_2_COUNT_ADDRESS);
+        return registers->read_register(LINE_DOWN_2_COUNT_ADDRESS);
     }
 
     uint32_t get_line_down_3_count()
     {
-        return ip.read_register(LINE_DOWN_3_COUNT_ADDRESS);
+        return registers->read_register(LINE_DOWN_3_COUNT_ADDRESS);
     }
 
     uint32_t get_pll_not_locked_count()
     {
-        return ip.read_register(PLL_NOT_LOCKED_COUNT_ADDRESS);
+        return registers->read_register(PLL_NOT_LOCKED_COUNT_ADDRESS);
     }
 
     uint32_t get_mmcm_not_locked_count()
     {
-        return ip.read_register(MMCM_NOT_LOCKED_COUNT_ADDRESS);
+        return registers->read_register(MMCM_NOT_LOCKED_COUNT_ADDRESS);
     }
 
     uint32_t get_hard_err_count()
     {
-        return ip.read_register(HARD_ERR_COUNT_ADDRESS);
+        return registers->read_register(HARD_ERR_COUNT_ADDRESS);
     }
 
     uint32_t get_soft_err_count()
     {
-        return ip.read_register(SOFT_ERR_COUNT_ADDRESS);
+        return registers->read_register(SOFT_ERR_COUNT_ADDRESS);
     }
 
     uint32_t get_channel_down_count()
     {
-        return ip.read_register(CHANNEL_DOWN_COUNT_ADDRESS);
+        return registers->read_register(CHANNEL_DOWN_COUNT_ADDRESS);
     }
 
     uint32_t get_frames_received()
     {
         if (has_tlast) {
-            return ip.read_register(FRAMES_RECEIVED_ADDRESS);
+            return registers->read_register(FRAMES_RECEIVED_ADDRESS);
         } else {
             return -1;
         }
@@ -424,12 +705,106 @@ public:
     uint32_t get_frames_with_errors()
     {
         if (has_tlast) {
-            return ip.read_register(FRAMES_WITH_ERRORS_ADDRESS);
+            return registers->read_register(FRAMES_WITH_ERRORS_ADDRESS);
         } else {
             return -1;
         }
     }
 
+    // Cycle counters for finding the bottleneck of a transmission
+
+    // user kernel blocked by the core, in ap_clk cycles
+    uint32_t get_tx_stall_count()
+    {
+        return registers->read_register(TX_STALL_COUNT_ADDRESS);
+    }
+
+    // received data not consumed by the user kernel, in ap_clk cycles
+    uint32_t get_rx_stall_count()
+    {
+        return registers->read_register(RX_STALL_COUNT_ADDRESS);
+    }
+
+    // partner paused by our NFC XOFF, in user_clk cycles
+    uint32_t get_nfc_xoff_count()
+    {
+        return registers->read_register(NFC_XOFF_COUNT_ADDRESS);
+    }
+
+    // channel up without data in either direction, in user_clk cycles
+    uint32_t get_idle_count()
+    {
+        return registers->read_register(IDLE_COUNT_ADDRESS);
+    }
+
+    // Histograms, reset with the counters
+
+    std::vector<uint32_t> read_histogram(uint32_t address)
+    {
+        std::vector<uint32_t> histogram(HISTOGRAM_BINS);
+        for (uint32_t bin = 0; bin < HISTOGRAM_BINS; bin++) {
+            histogram[bin] = registers->read_register(address + 4 * bin);
+        }
+        return histogram;
+    }
+
+    // flits received after sending an XOFF until the fifo dropped below
+    // the full threshold
+    std::vector<uint32_t> get_nfc_latency_histogram()
+    {
+        return read_histogram(NFC_LATENCY_HISTOGRAM_ADDRESS);
+    }
+
+    // fill level of the rx fifo in flits, sampled every user_clk cycle.
+    // The bins saturate instead of wrapping around
+    std::vector<uint32_t> get_fifo_rx_fill_histogram()
+    {
+        return read_histogram(FIFO_RX_FILL_HISTOGRAM_ADDRESS);
+    }
+
+    static uint32_t histogram_bin_min(uint32_t bin)
+    {
+        return bin == 0 ? 0 : 1 << (bin - 1);
+    }
+
+    static uint32_t histogram_bin_max(uint32_t bin)
+    {
+        return bin == HISTOGRAM_BINS - 1 ? 0xffffffff : (1 << bin) - 1;
+    }
+
+    // upper bound of all values in the histogram, e.g. the fifo depth
+    // needed for the observed fill levels
+    static uint32_t histogram_bound(const std::vector<uint32_t> &histogram)
+    {
+        for (uint32_t bin = HISTOGRAM_BINS; bin > 0; bin--) {
+            if (histogram[bin - 1]) {
+                return histogram_bin_max(bin - 1);
+            }
+        }
+        return 0;
+    }
+
+    void print_histogram(const std::vector<uint32_t> &histogram)
+    {
+        for (uint32_t bin = 0; bin < HISTOGRAM_BINS; bin++) {
+            if (histogram[bin]) {
+                std::cout << "  " << histogram_bin_min(bin) << " - " << histogram_bin_max(bin)
+                          << ": " << histogram[bin] << std::endl;
+            }
+        }
+    }
+
+    void print_histograms()
+    {
+        std::vector<uint32_t> latencies = get_nfc_latency_histogram();
+        std::cout << "NFC latency (flits), at most " << histogram_bound(latencies) << ":" << std::endl;
+        print_histogram(latencies);
+        std::vector<uint32_t> fill_levels = get_fifo_rx_fill_histogram();
+        std::cout << "RX FIFO fill level (flits), at most " << histogram_bound(fill_levels)
+                  << " of " << fifo_depth << ":" << std::endl;
+        print_histogram(fill_levels);
+    }
+
     void print_counters()
     {
         std::cout << "TX: " << get_tx_count() << std::endl;
@@ -456,20 +831,24 @@ public:
         std::cout << "Hard error: " << get_hard_err_count() << std::endl;
         std::cout << "Soft error: " << get_soft_err_count() << std::endl;
         std::cout << "Channel down: " << get_channel_down_count() << std::endl;
+        std::cout << "TX stalls: " << get_tx_stall_count() << std::endl;
+        std::cout << "RX stalls: " << get_rx_stall_count() << std::endl;
+        std::cout << "NFC XOFF: " << get_nfc_xoff_count() << std::endl;
+        std::cout << "Idle: " << get_idle_count() << std::endl;
     }
     
     // Reset routines
 
     void reset_core()
     {
-        ip.write_register(CORE_RESET_ADDRESS, true);
-        ip.write_register(CORE_RESET_ADDRESS, false);
+        registers->write_register(CORE_RESET_ADDRESS, true);
+        registers->write_register(CORE_RESET_ADDRESS, false);
     }
 
     void reset_counter()
     {
-        ip.write_register(COUNTER_RESET_ADDRESS, true);
-        ip.write_register(COUNTER_RESET_ADDRESS, false);
+        registers->write_register(COUNTER_RESET_ADDRESS, true);
+        registers->write_register(COUNTER_RESET_ADDRESS, false);
     }
 
     // Configuration
@@ -484,6 +863,14 @@ public:
     uint16_t fifo_prog_empty_threshold;
 
 private:
-    xrt::ip ip;
+    std::shared_ptr<AuroraRegisters> registers;
+
+    // low word first, the snapshot registers do not change in between
+    uint64_t read_register_64(uint32_t offset)
+    {
+        uint64_t low = registers->read_register(offset);
+        uint64_t high = registers->read_register(offset + 4);
+        return (high << 32) | low;
+    }
 };
 
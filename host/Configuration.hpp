@@ -1,17 +1,19 @@
 #pragma once
 
 #include <unistd.h>
+#include <algorithm>
 #include <cstdint>
 #include <string>
 #include <vector>
 #include <cmath>
 #include <iostream>
 #include <iomanip>
+#include <sstream>
 
 class Configuration
 {
 public:
-    const char *optstring = "m:o:b:p:i:r:f:nalt:ws";
+    const char *optstring = "m:o:b:p:i:r:f:nalt:wsd:vgck:x:q:u";
     // Defaults
     uint32_t device_id_offset = 0;
     std::string xclbin_file = "aurora_flow_test_hw.xclbin";
@@ -23,15 +25,41 @@ public:
     uint32_t timeout_ms = 10000; // 10 seconds
     bool wait = false;
     bool semaphore = false;
+    // number of repetitions in flight, the results of a repetition are
+    // verified while the next ones are running
+    uint32_t pipeline_depth = 1;
+    // compare the received data in the dump kernel instead of on the host
+    bool verify_on_device = false;
+    // generate the sent data in the issue kernel instead of reading it from memory
+    bool generate_on_device = false;
+    // repeat messages from the URAM cache of the issue kernel instead of
+    // reading them from memory in every iteration
+    bool cache_messages = false;
+    // run every message size with the data in memory and streamed on chip
+    bool compare_streaming = false;
+    // clock of the issue and dump kernels, to convert their timestamps
+    double kernel_frequency_mhz = 300.0;
+    // fill levels of the rx fifo in flits for XOFF and XON, zero keeps the
+    // thresholds of the bitstream
+    uint32_t nfc_full_threshold = 0;
+    uint32_t nfc_empty_threshold = 0;
+    // pause the partner with quanta instead of XOFF, negative keeps XOFF.
+    // Without quanta the ones of the bitstream are used
+    int32_t nfc_pause_step = -1;
+    std::vector<uint16_t> nfc_pause_quanta;
     // default for now
     bool randomize_data = true;
 
     uint32_t max_frame_size = 128;
     uint32_t max_num_bytes = 1048576;
+    // width of a flit of the issue and dump kernels in bytes, set by finish_setup
+    uint32_t fifo_width = 64;
 
     std::vector<uint32_t> message_sizes;
     std::vector<uint32_t> frame_sizes;
     std::vector<uint32_t> iterations_per_message;
+    // repetitions where the issue kernel generates and the dump kernel verifies the data
+    std::vector<uint32_t> streaming;
     std::vector<std::vector<char>> data;
 
     Configuration(int argc, char **argv)
@@ -63,9 +91,58 @@ public:
                 wait = true;
             } else if (opt == 's') {
                 semaphore = true; 
+            } else if (opt == 'd' && optarg) {
+                pipeline_depth = (uint32_t)(std::stoi(std::string(optarg)));
+            } else if (opt == 'v') {
+                verify_on_device = true;
+            } else if (opt == 'g') {
+                generate_on_device = true;
+            } else if (opt == 'c') {
+                compare_streaming = true;
+            } else if (opt == 'u') {
+                cache_messages = true;
+            } else if (opt == 'k' && optarg) {
+                kernel_frequency_mhz = std::stod(std::string(optarg));
+            } else if (opt == 'x' && optarg) {
+                std::string thresholds(optarg);
+                size_t comma = thresholds.find(',');
+                if (comma == std::string::npos) {
+                    std::cerr << "Error: NFC thresholds must be given as full,empty" << std::endl;
+                    exit(1);
+                }
+                nfc_full_threshold = (uint32_t)(std::stoi(thresholds.substr(0, comma)));
+                nfc_empty_threshold = (uint32_t)(std::stoi(thresholds.substr(comma + 1)));
+            } else if (opt == 'q' && optarg) {
+                std::stringstream pause(optarg);
+                std::string value;
+                std::getline(pause, value, ',');
+                nfc_pause_step = std::stoi(value);
+                while (std::getline(pause, value, ',')) {
+                    int quantum = std::stoi(value);
+                    if (quantum < 2 || quantum > 0xfffe) {
+                        std::cerr << "Error: NFC pause quanta must be between 2 and 65534 cycles" << std::endl;
+                        exit(1);
+                    }
+                    nfc_pause_quanta.push_back((uint16_t)quantum);
+                }
             }
         }
 
+        if (pipeline_depth < 1) {
+            std::cerr << "Error: pipeline depth must be at least 1" << std::endl;
+            exit(1);
+        }
+
+        if (nfc_full_threshold != 0 && nfc_empty_threshold >= nfc_full_threshold) {
+            std::cerr << "Error: NFC empty threshold must be below the full threshold" << std::endl;
+            exit(1);
+        }
+
+        if (nfc_pause_step > 31 || (!nfc_pause_quanta.empty() && nfc_pause_quanta.size() != 4)) {
+            std::cerr << "Error: NFC pause mode must be given as step or step,q0,q1,q2,q3 with a step below 32" << std::endl;
+            exit(1);
+        }
+
         if (xclbin_file == "") {
             std::cerr << "Error: no bitstream file passed" << std::endl;
             exit(1);
@@ -78,6 +155,7 @@ public:
     }
 
     void finish_setup(uint32_t fifo_width, bool has_framing, bool emulation) {
+        this->fifo_width = fifo_width;
         if ((max_num_bytes % fifo_width ) != 0) {
             std::cout << "Error: number of bytes must be multiple of the fifo width " << fifo_width << std::endl;
             exit(1);
@@ -126,6 +204,62 @@ public:
                 iterations_per_message[i] = iterations;
             }
         }
+        streaming.assign(repetitions, 0);
+        if (compare_streaming) {
+            // every repetition is run from memory first and then streamed
+            std::vector<uint32_t> sizes, frames, its, modes;
+            for (uint32_t i = 0; i < repetitions; i++) {
+                for (uint32_t s = 0; s < 2; s++) {
+                    sizes.push_back(message_sizes[i]);
+                    frames.push_back(frame_sizes[i]);
+                    its.push_back(iterations_per_message[i]);
+                    modes.push_back(s);
+                }
+            }
+            message_sizes = sizes;
+            frame_sizes = frames;
+            iterations_per_message = its;
+            streaming = modes;
+            repetitions *= 2;
+        }
+    }
+
+    uint32_t max_iterations()
+    {
+        return *std::max_element(iterations_per_message.begin(), iterations_per_message.end());
+    }
+
+    bool generate_on_device_in(uint32_t repetition)
+    {
+        return generate_on_device || streaming[repetition];
+    }
+
+    bool verify_on_device_in(uint32_t repetition)
+    {
+        return verify_on_device || streaming[repetition];
+    }
+
+    // the cache only matters when the data is read from memory
+    bool cache_in(uint32_t repetition)
+    {
+        return cache_messages && !generate_on_device_in(repetition);
+    }
+
+    // where the data comes from and goes to
+    std::string data_path(uint32_t repetition)
+    {
+        bool source = generate_on_device_in(repetition);
+        bool sink = verify_on_device_in(repetition);
+        if (source && sink) {
+            return "stream";
+        } else if (source) {
+            return "source";
+        } else if (cache_in(repetition)) {
+            return sink ? "cache+sink" : "cache";
+        } else if (sink) {
+            return "sink";
+        }
+        return "memory";
     }
 
     void print()
@@ -140,6 +274,8 @@ public:
             std::cout << "Pair mode with ack" << std::endl; 
         } else if (test_mode == 2) {
             std::cout << "Ring mode without ack" << std::endl; 
+        } else if (test_mode == 4) {
+            std::cout << "Bonded pair mode without ack, striped over both cores" << std::endl;
         } else {
             std::cout << "Unsupported mode without verification" << std::endl; 
         }
@@ -175,6 +311,27 @@ public:
             std::cout << iterations << " iterations" << std::endl;
         }
         std::cout << repetitions << " repetitions" << std::endl;
+        if (pipeline_depth > 1) {
+            std::cout << "Verifying while transmitting with " << pipeline_depth << " buffers" << std::endl;
+        }
+        if (verify_on_device) {
+            std::cout << "Verifying on the device" << std::endl;
+        }
+        if (generate_on_device) {
+            std::cout << "Generating data on the device" << std::endl;
+        }
+        if (cache_messages) {
+            std::cout << "Repeating messages from the cache of the issue kernel" << std::endl;
+        }
+        if (compare_streaming) {
+            std::cout << "Comparing data in memory with data streamed on the device" << std::endl;
+        }
+        if (nfc_full_threshold != 0) {
+            std::cout << "NFC thresholds: XOFF at " << nfc_full_threshold << ", XON at " << nfc_empty_threshold << " flits" << std::endl;
+        }
+        if (nfc_pause_step >= 0) {
+            std::cout << "NFC pause quanta every " << (1u << nfc_pause_step) << " flits above the full threshold" << std::endl;
+        }
         std::cout << "Issue/Dump timeout: " << timeout_ms << " ms" << std::endl;
     }
 
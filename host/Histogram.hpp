@@ -0,0 +1,70 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// Histogram of times in seconds with logarithmic buckets. Every power of
+// two is divided into SUB_BUCKETS buckets, so the percentiles have a
+// relative error of less than 5% over the whole range from 1 ns to days.
+// Histograms of different ranks are merged by adding the counts.
+class Histogram
+{
+public:
+    static const uint32_t SUB_BUCKETS = 16;
+    static const uint32_t OCTAVES = 48;
+    // resolution of the first bucket
+    static constexpr double UNIT = 1e-9;
+    static const uint32_t NUM_BUCKETS = SUB_BUCKETS * OCTAVES + 1;
+
+    std::vector<uint64_t> counts;
+    uint64_t count = 0;
+    double min = std::numeric_limits<double>::infinity();
+    double max = 0.0;
+
+    Histogram() : counts(NUM_BUCKETS, 0) {}
+
+    // bucket 0 holds all times below UNIT, bucket b > 0 the times from
+    // UNIT * 2^((b - 1) / SUB_BUCKETS) to UNIT * 2^(b / SUB_BUCKETS)
+    static uint32_t bucket(double value)
+    {
+        double units = value / UNIT;
+        if (units < 1.0) {
+            return 0;
+        }
+        return std::min(NUM_BUCKETS - 1, 1 + (uint32_t)(std::log2(units) * SUB_BUCKETS));
+    }
+
+    static double upper_bound(uint32_t bucket)
+    {
+        return UNIT * std::exp2((double)bucket / SUB_BUCKETS);
+    }
+
+    void add(double value)
+    {
+        counts[bucket(value)]++;
+        count++;
+        min = std::min(min, value);
+        max = std::max(max, value);
+    }
+
+    // upper bound of the bucket holding the given percentile, but never
+    // more than the exact maximum
+    double percentile(double p)
+    {
+        if (count == 0) {
+            return std::numeric_limits<double>::quiet_NaN();
+        }
+        uint64_t rank = std::max((uint64_t)1, (uint64_t)std::ceil(p / 100.0 * count));
+        uint64_t cumulative = 0;
+        for (uint32_t b = 0; b < NUM_BUCKETS; b++) {
+            cumulative += counts[b];
+            if (cumulative >= rank) {
+                return std::min(upper_bound(b), max);
+            }
+        }
+        return max;
+    }
+};
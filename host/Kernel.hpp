@@ -1,16 +1,39 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+// bytes that are compared at once before looking at single flits
+static const uint32_t COMPARE_BLOCK_BYTES = 4096;
+// minimum number of bytes a verification thread compares
+static const uint32_t COMPARE_BYTES_PER_THREAD = 1048576;
+
+// cycles recorded per iteration, same as in hls/issue.cpp and hls/dump.cpp
+// issue: first flit, last flit and acknowledgement
+static const uint32_t ISSUE_TIMESTAMPS = 3;
+// dump: first and last flit
+static const uint32_t DUMP_TIMESTAMPS = 2;
+
 class IssueKernel
 {
 public:
-    IssueKernel(uint32_t rank, xrt::device &device, xrt::uuid &xclbin_uuid, Configuration &config, std::vector<char> &data) : rank(rank), config(config)
+    IssueKernel(uint32_t rank, uint32_t instance, xrt::device &device, xrt::uuid &xclbin_uuid, Configuration &config, std::vector<char> &data, uint64_t seed) : rank(rank), seed(seed), config(config)
     {
         char name[100];
-        snprintf(name, 100, "issue:{issue_%u}", rank % 2);
+        snprintf(name, 100, "issue:{issue_%u}", instance);
         kernel = xrt::kernel(device, xclbin_uuid, name);
 
         data_bo = xrt::bo(device, config.max_num_bytes, xrt::bo::flags::normal, kernel.group_id(1));
 
         data_bo.write(data.data());
         data_bo.sync(XCL_BO_SYNC_BO_TO_DEVICE);
+
+        timestamps.resize(ISSUE_TIMESTAMPS * config.max_iterations());
+        timestamps_bo = xrt::bo(device, timestamps.size() * sizeof(uint64_t), xrt::bo::flags::normal, kernel.group_id(11));
   }
 
     void prepare_repetition(uint32_t repetition)
@@ -22,6 +45,10 @@ public:
         run.set_arg(3, config.frame_sizes[repetition]);
         run.set_arg(4, config.iterations_per_message[repetition]);
         run.set_arg(5, config.test_mode);
+        run.set_arg(8, config.generate_on_device_in(repetition) ? 1u : 0u);
+        run.set_arg(9, seed);
+        run.set_arg(10, config.cache_in(repetition) ? 1u : 0u);
+        run.set_arg(11, timestamps_bo);
     }
 
     void start()
@@ -34,12 +61,23 @@ public:
         return run.wait(std::chrono::milliseconds(config.timeout_ms)) == ERT_CMD_STATE_TIMEOUT;
     }
 
+    void read_timestamps(uint32_t repetition)
+    {
+        size_t num_bytes = ISSUE_TIMESTAMPS * config.iterations_per_message[repetition] * sizeof(uint64_t);
+        timestamps_bo.sync(XCL_BO_SYNC_BO_FROM_DEVICE, num_bytes, 0);
+        timestamps_bo.read(timestamps.data(), num_bytes, 0);
+    }
+
     std::vector<char> data;
+    std::vector<uint64_t> timestamps;
 private:
     xrt::bo data_bo;
+    xrt::bo timestamps_bo;
     xrt::kernel kernel;
     xrt::run run;
     uint32_t rank;
+    // seed of the data, if it is generated on the device
+    uint64_t seed;
     Configuration &config;
 };
 
@@ -47,27 +85,42 @@ class DumpKernel
 {
 public:
 
-    DumpKernel(uint32_t rank, xrt::device &device, xrt::uuid &xclbin_uuid, Configuration &config) : rank(rank), config(config)
+    DumpKernel(uint32_t rank, uint32_t instance, xrt::device &device, xrt::uuid &xclbin_uuid, Configuration &config, uint64_t seed) : rank(rank), seed(seed), config(config)
     {
         char name[100];
-        snprintf(name, 100, "dump:{dump_%u}", rank % 2);
+        snprintf(name, 100, "dump:{dump_%u}", instance);
         kernel = xrt::kernel(device, xclbin_uuid, name);
 
 
-        data_bo = xrt::bo(device, config.max_num_bytes, xrt::bo::flags::normal, kernel.group_id(1));
+        // one buffer per repetition in flight, so the results of a
+        // repetition can be verified while the next one is running
+        data_bos.resize(config.pipeline_depth);
+        data.resize(config.pipeline_depth);
+        for (uint32_t b = 0; b < config.pipeline_depth; b++) {
+            data_bos[b] = xrt::bo(device, config.max_num_bytes, xrt::bo::flags::normal, kernel.group_id(1));
+            data[b].resize(config.max_num_bytes);
+        }
 
-        data.resize(config.max_num_bytes);
+        timestamps.resize(DUMP_TIMESTAMPS * config.max_iterations());
+        timestamps_bo = xrt::bo(device, timestamps.size() * sizeof(uint64_t), xrt::bo::flags::normal, kernel.group_id(9));
+    }
 
+    uint32_t buffer(uint32_t repetition)
+    {
+        return repetition % config.pipeline_depth;
     }
 
     void prepare_repetition(uint32_t repetition)
     {
         run = xrt::run(kernel);
 
-        run.set_arg(1, data_bo);
+        run.set_arg(1, data_bos[buffer(repetition)]);
         run.set_arg(2, config.message_sizes[repetition]);
         run.set_arg(3, config.iterations_per_message[repetition]);
         run.set_arg(4, config.test_mode);
+        run.set_arg(7, config.verify_on_device_in(repetition) ? 1u : 0u);
+        run.set_arg(8, seed);
+        run.set_arg(9, timestamps_bo);
     }
 
     void start()
@@ -80,40 +133,211 @@ public:
         return run.wait(std::chrono::milliseconds(config.timeout_ms)) == ERT_CMD_STATE_TIMEOUT;
     }
 
-    void write_back()
+    void read_timestamps(uint32_t repetition)
     {
-        data_bo.sync(XCL_BO_SYNC_BO_FROM_DEVICE);
-        data_bo.read(data.data());
+        size_t num_bytes = DUMP_TIMESTAMPS * config.iterations_per_message[repetition] * sizeof(uint64_t);
+        timestamps_bo.sync(XCL_BO_SYNC_BO_FROM_DEVICE, num_bytes, 0);
+        timestamps_bo.read(timestamps.data(), num_bytes, 0);
     }
 
-    uint32_t compare_data(char *ref, uint32_t repetition)
+    void write_back(uint32_t repetition)
     {
-        uint32_t err_num = 0;
-        for (uint32_t i = 0; i < config.message_sizes[repetition]; i++) {
-            if (data[i] != ref[i]) {
-                if (err_num < 16) {
-                    printf("dump[%d] = %02x, issue[%d] = %02x\n", i, (uint8_t)data[i], i, (uint8_t)ref[i]);
+        uint32_t b = buffer(repetition);
+        // when verifying on the device, only the result in the first flit is written
+        uint32_t num_bytes = config.verify_on_device_in(repetition) ? config.fifo_width : config.message_sizes[repetition];
+        data_bos[b].sync(XCL_BO_SYNC_BO_FROM_DEVICE, num_bytes, 0);
+        data_bos[b].read(data[b].data(), num_bytes, 0);
+    }
+
+    // result of the dump kernel: the number of mismatched bytes and the
+    // offset of the first one, summed up over all iterations
+    uint32_t device_result(uint32_t repetition)
+    {
+        uint32_t result[2];
+        memcpy(result, data[buffer(repetition)].data(), sizeof(result));
+        if (result[0]) {
+            std::ostringstream out;
+            out << "Data verification FAIL" << std::endl;
+            out << "for Dump Kernel " << rank << std::endl;
+            out << "in repetition " << repetition << std::endl;
+            out << "Total mismatched bytes: " << result[0] << " in " << config.iterations_per_message[repetition] << " iterations" << std::endl;
+            out << "First mismatch at byte " << result[1] << " (flit " << result[1] / config.fifo_width << ")" << std::endl;
+            std::cout << out.str();
+        }
+        return result[0];
+    }
+
+    // mismatches found in a part of a message
+    struct Mismatches
+    {
+        uint32_t bytes = 0;
+        // indices of the flits with at least one mismatched byte
+        std::vector<uint32_t> flits;
+    };
+
+    // compare whole blocks first, which memcmp vectorizes, and only look
+    // into the flits and bytes of blocks that differ
+    static void compare_range(const char *data, const char *ref, uint32_t begin, uint32_t end, uint32_t flit_bytes, Mismatches &mismatches)
+    {
+        for (uint32_t block = begin; block < end; block += COMPARE_BLOCK_BYTES) {
+            uint32_t block_end = std::min(end, block + COMPARE_BLOCK_BYTES);
+            if (memcmp(data + block, ref + block, block_end - block) == 0) {
+                continue;
+            }
+            for (uint32_t flit = block; flit < block_end; flit += flit_bytes) {
+                uint32_t flit_end = std::min(block_end, flit + flit_bytes);
+                if (memcmp(data + flit, ref + flit, flit_end - flit) == 0) {
+                    continue;
+                }
+                mismatches.flits.push_back(flit / flit_bytes);
+                for (uint32_t i = flit; i < flit_end; i++) {
+                    mismatches.bytes += (data[i] != ref[i]);
                 }
-                err_num++;
             }
         }
+    }
+
+    uint32_t compare_data(char *ref, uint32_t repetition)
+    {
+        if (config.verify_on_device_in(repetition)) {
+            return device_result(repetition);
+        }
+        const char *data = this->data[buffer(repetition)].data();
+        uint32_t num_bytes = config.message_sizes[repetition];
+        uint32_t flit_bytes = config.fifo_width;
+        uint32_t frame_size = config.frame_sizes[repetition];
+
+        // split into ranges of whole blocks, one per thread
+        uint32_t num_threads = std::max(1u, std::min(std::thread::hardware_concurrency(), num_bytes / COMPARE_BYTES_PER_THREAD));
+        uint32_t blocks = (num_bytes + COMPARE_BLOCK_BYTES - 1) / COMPARE_BLOCK_BYTES;
+        uint32_t blocks_per_thread = (blocks + num_threads - 1) / num_threads;
+        std::vector<Mismatches> mismatches(num_threads);
+        std::vector<std::thread> threads;
+        for (uint32_t t = 0; t < num_threads; t++) {
+            uint32_t begin = std::min(num_bytes, t * blocks_per_thread * COMPARE_BLOCK_BYTES);
+            uint32_t end = std::min(num_bytes, (t + 1) * blocks_per_thread * COMPARE_BLOCK_BYTES);
+            threads.emplace_back(compare_range, data, ref, begin, end, flit_bytes, std::ref(mismatches[t]));
+        }
+        uint32_t err_num = 0;
+        std::vector<uint32_t> error_flits;
+        for (uint32_t t = 0; t < num_threads; t++) {
+            threads[t].join();
+            err_num += mismatches[t].bytes;
+            error_flits.insert(error_flits.end(), mismatches[t].flits.begin(), mismatches[t].flits.end());
+        }
+
         if (err_num) {
-            std::cout << "Data verification FAIL" << std::endl;
-            std::cout << "for Dump Kernel " << rank << std::endl;
-            std::cout << "in repetition " << repetition << std::endl;
-            std::cout << "Total mismatched bytes: " << err_num << std::endl;
-            std::cout << "Ratio: " << (double)err_num/(double) config.message_sizes[repetition] << std::endl;
+            // collect the output, verifications of several repetitions may run in parallel
+            std::ostringstream out;
+            uint32_t printed = 0;
+            for (uint32_t flit: error_flits) {
+                for (uint32_t i = flit * flit_bytes; i < std::min(num_bytes, (flit + 1) * flit_bytes) && printed < 16; i++) {
+                    if (data[i] != ref[i]) {
+                        char line[100];
+                        snprintf(line, 100, "dump[%d] = %02x, issue[%d] = %02x", i, (uint8_t)data[i], i, (uint8_t)ref[i]);
+                        out << line << " (flit " << flit;
+                        if (frame_size > 0) {
+                            out << ", frame " << flit / frame_size;
+                        }
+                        out << ")" << std::endl;
+                        printed++;
+                    }
+                }
+            }
+            out << "Data verification FAIL" << std::endl;
+            out << "for Dump Kernel " << rank << std::endl;
+            out << "in repetition " << repetition << std::endl;
+            out << "Total mismatched bytes: " << err_num << std::endl;
+            out << "Ratio: " << (double)err_num/(double) num_bytes << std::endl;
+            out << "Mismatched flits: " << error_flits.size() << ", first at flit " << error_flits.front() << std::endl;
+            if (frame_size > 0) {
+                // flits are sorted, so the frames with errors can be counted in one pass
+                uint32_t error_frames = 0;
+                uint32_t last_frame = UINT32_MAX;
+                for (uint32_t flit: error_flits) {
+                    if (flit / frame_size != last_frame) {
+                        last_frame = flit / frame_size;
+                        error_frames++;
+                    }
+                }
+                out << "Mismatched frames: " << error_frames << ", first at frame " << error_flits.front() / frame_size << std::endl;
+            }
+            std::cout << out.str();
         }
         return err_num;
     }
 
-    std::vector<char> data;
+    std::vector<std::vector<char>> data;
+    std::vector<uint64_t> timestamps;
 
 private:
-    xrt::bo data_bo;
+    std::vector<xrt::bo> data_bos;
+    xrt::bo timestamps_bo;
     xrt::kernel kernel;
     xrt::run run;
     uint32_t rank;
+    // seed of the data sent by the issue kernel
+    uint64_t seed;
     Configuration &config;
 };
 
+// stripe and merge kernels of the bonded design, which split the flits of
+// the issue kernel over both cores and join them again for the dump kernel
+class BondKernels
+{
+public:
+    BondKernels(xrt::device &device, xrt::uuid &xclbin_uuid, Configuration &config, bool swapped) : swapped(swapped), config(config)
+    {
+        stripe_kernel = xrt::kernel(device, xclbin_uuid, "stripe:{stripe_0}");
+        merge_kernel = xrt::kernel(device, xclbin_uuid, "merge:{merge_0}");
+        errors_bo = xrt::bo(device, sizeof(uint32_t), xrt::bo::flags::normal, merge_kernel.group_id(6));
+    }
+
+    void prepare_repetition(uint32_t repetition)
+    {
+        uint32_t flits = config.message_sizes[repetition] / config.fifo_width * config.iterations_per_message[repetition];
+
+        stripe_run = xrt::run(stripe_kernel);
+        stripe_run.set_arg(3, flits);
+
+        merge_run = xrt::run(merge_kernel);
+        merge_run.set_arg(3, flits);
+        merge_run.set_arg(4, swapped ? 1u : 0u);
+        // merge gives up on missing flits after half of the timeout, so
+        // it finishes before the host stops waiting for it
+        double timeout_cycles = config.timeout_ms / 2 * config.kernel_frequency_mhz * 1000.0;
+        merge_run.set_arg(5, (uint32_t)std::min(timeout_cycles, (double)UINT32_MAX));
+        merge_run.set_arg(6, errors_bo);
+    }
+
+    void start()
+    {
+        merge_run.start();
+        stripe_run.start();
+    }
+
+    bool timeout()
+    {
+        return (stripe_run.wait(std::chrono::milliseconds(config.timeout_ms)) == ERT_CMD_STATE_TIMEOUT)
+            || (merge_run.wait(std::chrono::milliseconds(config.timeout_ms)) == ERT_CMD_STATE_TIMEOUT);
+    }
+
+    // number of blocks merge replaced by zeros, because flits were lost
+    uint32_t errors()
+    {
+        uint32_t errors;
+        errors_bo.sync(XCL_BO_SYNC_BO_FROM_DEVICE, sizeof(uint32_t), 0);
+        errors_bo.read(&errors, sizeof(uint32_t), 0);
+        return errors;
+    }
+
+private:
+    xrt::kernel stripe_kernel;
+    xrt::kernel merge_kernel;
+    xrt::run stripe_run;
+    xrt::run merge_run;
+    xrt::bo errors_bo;
+    // the even flits arrive on core 1
+    bool swapped;
+    Configuration &config;
+};
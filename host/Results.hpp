@@ -1,3 +1,80 @@
+// percentiles and maximum of round trip and one way latency and median receive time
+const uint32_t LATENCY_STATS = 2 * 4 + 1;
+const uint32_t REPETITION_COUNTERS = 31;
+// flits, bytes and kernel clock cycles between the snapshots
+const uint32_t REPETITION_SNAPSHOT = 5;
+
+// Everything a rank measures in one repetition, so the results of all
+// ranks and repetitions are collected with a single gather. The counters
+// have to stay consecutive for the MPI datatype below.
+struct RepetitionResult
+{
+    double transmission_time;
+    double latency_stats[LATENCY_STATS];
+
+    uint64_t tx_count;
+    uint64_t rx_count;
+    uint64_t tx_bytes;
+    uint64_t rx_bytes;
+    uint64_t cycles;
+
+    uint32_t failed_transmissions;
+    uint32_t errors;
+    uint32_t fifo_rx_overflow_count;
+    uint32_t fifo_tx_overflow_count;
+    uint32_t nfc_full_trigger_count;
+    uint32_t nfc_empty_trigger_count;
+    uint32_t nfc_latency_count;
+    uint32_t gt_not_ready_0_count;
+    uint32_t gt_not_ready_1_count;
+    uint32_t gt_not_ready_2_count;
+    uint32_t gt_not_ready_3_count;
+    uint32_t line_down_0_count;
+    uint32_t line_down_1_count;
+    uint32_t line_down_2_count;
+    uint32_t line_down_3_count;
+    uint32_t pll_not_locked_count;
+    uint32_t mmcm_not_locked_count;
+    uint32_t hard_err_count;
+    uint32_t soft_err_count;
+    uint32_t channel_down_count;
+    uint32_t frames_received;
+    uint32_t frames_with_errors;
+    uint32_t tx_stall_count;
+    uint32_t rx_stall_count;
+    uint32_t nfc_xoff_count;
+    uint32_t idle_count;
+    // upper bounds from the histograms of the nfc
+    uint32_t nfc_latency_bound;
+    uint32_t fifo_rx_fill_bound;
+    // nfc configuration of the core, the step is -1 for XOFF
+    uint32_t nfc_full_threshold;
+    uint32_t nfc_empty_threshold;
+    int32_t nfc_pause_step;
+};
+
+static_assert(offsetof(RepetitionResult, latency_stats) == offsetof(RepetitionResult, transmission_time) + sizeof(double),
+              "the doubles of RepetitionResult have to be consecutive");
+static_assert(offsetof(RepetitionResult, cycles) == offsetof(RepetitionResult, tx_count) + (REPETITION_SNAPSHOT - 1) * sizeof(uint64_t),
+              "the snapshot of RepetitionResult has to be consecutive");
+static_assert(offsetof(RepetitionResult, nfc_pause_step) == offsetof(RepetitionResult, failed_transmissions) + (REPETITION_COUNTERS - 1) * sizeof(uint32_t),
+              "the counters of RepetitionResult have to be consecutive");
+
+// one block of doubles, one of the snapshot and one of counters, resized to
+// include the padding
+MPI_Datatype create_repetition_result_type()
+{
+    int lengths[3] = {1 + LATENCY_STATS, REPETITION_SNAPSHOT, REPETITION_COUNTERS};
+    MPI_Aint displacements[3] = {offsetof(RepetitionResult, transmission_time), offsetof(RepetitionResult, tx_count), offsetof(RepetitionResult, failed_transmissions)};
+    MPI_Datatype types[3] = {MPI_DOUBLE, MPI_UINT64_T, MPI_UNSIGNED};
+    MPI_Datatype packed, resized;
+    MPI_Type_create_struct(3, lengths, displacements, types, &packed);
+    MPI_Type_create_resized(packed, 0, sizeof(RepetitionResult), &resized);
+    MPI_Type_commit(&resized);
+    MPI_Type_free(&packed);
+    return resized;
+}
+
 class Results
 {
 public:
@@ -6,221 +83,225 @@ public:
 
     std::string local_bdf;
     uint32_t local_aurora_config;
-    std::vector<double> local_transmission_times;
-    std::vector<uint32_t> local_failed_transmissions;
-    std::vector<uint32_t> local_errors;
-    std::vector<uint32_t> local_fifo_rx_overflow_count;
-    std::vector<uint32_t> local_fifo_tx_overflow_count;
-    std::vector<uint32_t> local_nfc_full_trigger_count;
-    std::vector<uint32_t> local_nfc_empty_trigger_count;
-    std::vector<uint32_t> local_nfc_latency_count;
-    std::vector<uint32_t> local_tx_count;
-    std::vector<uint32_t> local_rx_count;
-    std::vector<uint32_t> local_gt_not_ready_0_count;
-    std::vector<uint32_t> local_gt_not_ready_1_count;
-    std::vector<uint32_t> local_gt_not_ready_2_count;
-    std::vector<uint32_t> local_gt_not_ready_3_count;
-    std::vector<uint32_t> local_line_down_0_count;
-    std::vector<uint32_t> local_line_down_1_count;
-    std::vector<uint32_t> local_line_down_2_count;
-    std::vector<uint32_t> local_line_down_3_count;
-    std::vector<uint32_t> local_pll_not_locked_count;
-    std::vector<uint32_t> local_mmcm_not_locked_count;
-    std::vector<uint32_t> local_hard_err_count;
-    std::vector<uint32_t> local_soft_err_count;
-    std::vector<uint32_t> local_channel_down_count;
-    std::vector<uint32_t> local_frames_received;
-    std::vector<uint32_t> local_frames_with_errors;
+    // per repetition of this rank
+    std::vector<RepetitionResult> local_results;
+    // counters latched by snapshot_begin()
+    RepetitionResult snapshot_start;
+
+    // per iteration, from the timestamps of the kernels, in seconds
+    // first flit sent until acknowledgement received
+    std::vector<double> local_round_trip_latencies;
+    // last flit sent until acknowledgement received
+    std::vector<double> local_one_way_latencies;
+    // first until last flit received
+    std::vector<double> local_receive_times;
+    // index of the first iteration of every repetition
+    std::vector<uint32_t> sample_offsets;
 
     std::vector<char> total_bdf_raw;
     std::vector<std::string> total_bdf;
     const int BDF_SIZE = 12; 
 
     std::vector<uint32_t> total_aurora_config;
-    std::vector<double> total_transmission_times;
-    std::vector<uint32_t> total_failed_transmissions;
-    std::vector<uint32_t> total_errors;
-    std::vector<uint32_t> total_fifo_rx_overflow_count;
-    std::vector<uint32_t> total_fifo_tx_overflow_count;
-    std::vector<uint32_t> total_nfc_full_trigger_count;
-    std::vector<uint32_t> total_nfc_empty_trigger_count;
-    std::vector<uint32_t> total_nfc_latency_count;
-    std::vector<uint32_t> total_tx_count;
-    std::vector<uint32_t> total_rx_count;
-    std::vector<uint32_t> total_gt_not_ready_0_count;
-    std::vector<uint32_t> total_gt_not_ready_1_count;
-    std::vector<uint32_t> total_gt_not_ready_2_count;
-    std::vector<uint32_t> total_gt_not_ready_3_count;
-    std::vector<uint32_t> total_line_down_0_count;
-    std::vector<uint32_t> total_line_down_1_count;
-    std::vector<uint32_t> total_line_down_2_count;
-    std::vector<uint32_t> total_line_down_3_count;
-    std::vector<uint32_t> total_pll_not_locked_count;
-    std::vector<uint32_t> total_mmcm_not_locked_count;
-    std::vector<uint32_t> total_hard_err_count;
-    std::vector<uint32_t> total_soft_err_count;
-    std::vector<uint32_t> total_channel_down_count;
-    std::vector<uint32_t> total_frames_received;
-    std::vector<uint32_t> total_frames_with_errors;
+    // per repetition of all ranks, rank after rank
+    std::vector<RepetitionResult> total_results;
+
+    // per repetition, of this rank and merged on rank 0
+    std::vector<Histogram> local_round_trip_histograms;
+    std::vector<Histogram> local_one_way_histograms;
+    std::vector<Histogram> local_receive_histograms;
+    std::vector<Histogram> total_round_trip_histograms;
+    std::vector<Histogram> total_one_way_histograms;
+    std::vector<Histogram> total_receive_histograms;
+
+    // percentiles of the latencies reported besides the maximum
+    const std::vector<double> PERCENTILES = {50.0, 99.0, 99.9};
 
     bool emulation;
     int world_size;
 
     Results(Configuration &config, Aurora &aurora, bool emulation, xrt::device &device, int32_t world_size) : config(config), aurora(aurora), emulation(emulation), world_size(world_size)
     {
-        local_transmission_times.resize(config.repetitions);
-        local_failed_transmissions.resize(config.repetitions);
-        local_fifo_rx_overflow_count.resize(config.repetitions);
-        local_fifo_tx_overflow_count.resize(config.repetitions);
-        local_nfc_full_trigger_count.resize(config.repetitions);
-        local_nfc_empty_trigger_count.resize(config.repetitions);
-        local_nfc_latency_count.resize(config.repetitions);
-        local_errors.resize(config.repetitions);
-        local_frames_received.resize(config.repetitions);
-        local_frames_with_errors.resize(config.repetitions);
-        local_tx_count.resize(config.repetitions);
-        local_rx_count.resize(config.repetitions);
-        
-        local_gt_not_ready_0_count.resize(config.repetitions);
-        local_gt_not_ready_1_count.resize(config.repetitions);
-        local_gt_not_ready_2_count.resize(config.repetitions);
-        local_gt_not_ready_3_count.resize(config.repetitions);
-
-        local_line_down_0_count.resize(config.repetitions);
-        local_line_down_1_count.resize(config.repetitions);
-        local_line_down_2_count.resize(config.repetitions);
-        local_line_down_3_count.resize(config.repetitions);
-
-        local_pll_not_locked_count.resize(config.repetitions);
-        local_mmcm_not_locked_count.resize(config.repetitions);
-        local_hard_err_count.resize(config.repetitions);
-        local_soft_err_count.resize(config.repetitions);
-
-        local_channel_down_count.resize(config.repetitions);
+        local_results.resize(config.repetitions);
+
+        sample_offsets.resize(config.repetitions + 1);
+        for (uint32_t r = 0; r < config.repetitions; r++) {
+            sample_offsets[r + 1] = sample_offsets[r] + config.iterations_per_message[r];
+        }
+        local_round_trip_latencies.resize(num_samples());
+        local_one_way_latencies.resize(num_samples());
+        local_receive_times.resize(num_samples());
 
         local_bdf = device.get_info<xrt::info::device::bdf>();
 
-        if (!emulation) {
-            local_aurora_config = aurora.get_configuration();
-            aurora.reset_counter();
-        }
+        local_aurora_config = aurora.get_configuration();
+        aurora.reset_counter();
     }
 
     void update_counter(uint32_t repetition)
     {
-        if (!emulation) {
-
-            local_fifo_rx_overflow_count[repetition] = aurora.get_fifo_rx_overflow_count();
-            local_fifo_tx_overflow_count[repetition] = aurora.get_fifo_tx_overflow_count();
-            local_nfc_full_trigger_count[repetition] = aurora.get_nfc_full_trigger_count();
-            local_nfc_empty_trigger_count[repetition] = aurora.get_nfc_empty_trigger_count();
-            local_nfc_latency_count[repetition] = aurora.get_nfc_latency_count();
-
-            local_tx_count[repetition] = aurora.get_tx_count();
-            local_rx_count[repetition] = aurora.get_rx_count();
+        local_results[repetition].fifo_rx_overflow_count = aurora.get_fifo_rx_overflow_count();
+        local_results[repetition].fifo_tx_overflow_count = aurora.get_fifo_tx_overflow_count();
+        local_results[repetition].nfc_full_trigger_count = aurora.get_nfc_full_trigger_count();
+        local_results[repetition].nfc_empty_trigger_count = aurora.get_nfc_empty_trigger_count();
+        local_results[repetition].nfc_latency_count = aurora.get_nfc_latency_count();
+
+        local_results[repetition].gt_not_ready_0_count = aurora.get_gt_not_ready_0_count();
+        local_results[repetition].gt_not_ready_1_count = aurora.get_gt_not_ready_1_count();
+        local_results[repetition].gt_not_ready_2_count = aurora.get_gt_not_ready_2_count();
+        local_results[repetition].gt_not_ready_3_count = aurora.get_gt_not_ready_3_count();
+
+        local_results[repetition].line_down_0_count = aurora.get_line_down_0_count();
+        local_results[repetition].line_down_1_count = aurora.get_line_down_1_count();
+        local_results[repetition].line_down_2_count = aurora.get_line_down_2_count();
+        local_results[repetition].line_down_3_count = aurora.get_line_down_3_count();
+
+        local_results[repetition].pll_not_locked_count = aurora.get_pll_not_locked_count();
+        local_results[repetition].mmcm_not_locked_count = aurora.get_mmcm_not_locked_count();
+        local_results[repetition].hard_err_count = aurora.get_hard_err_count();
+        local_results[repetition].soft_err_count = aurora.get_soft_err_count();
+
+        local_results[repetition].channel_down_count = aurora.get_channel_down_count();
+
+        local_results[repetition].tx_stall_count = aurora.get_tx_stall_count();
+        local_results[repetition].rx_stall_count = aurora.get_rx_stall_count();
+        local_results[repetition].nfc_xoff_count = aurora.get_nfc_xoff_count();
+        local_results[repetition].idle_count = aurora.get_idle_count();
+
+        local_results[repetition].nfc_latency_bound = Aurora::histogram_bound(aurora.get_nfc_latency_histogram());
+        local_results[repetition].fifo_rx_fill_bound = Aurora::histogram_bound(aurora.get_fifo_rx_fill_histogram());
+
+        local_results[repetition].nfc_full_threshold = aurora.get_nfc_full_threshold();
+        local_results[repetition].nfc_empty_threshold = aurora.get_nfc_empty_threshold();
+        local_results[repetition].nfc_pause_step = aurora.get_nfc_pause_mode() ? aurora.get_nfc_pause_step() : -1;
+
+        if (aurora.has_framing()) {
+            local_results[repetition].frames_received = aurora.get_frames_received();
+            local_results[repetition].frames_with_errors = aurora.get_frames_with_errors();
+        }
 
-            local_gt_not_ready_0_count[repetition] = aurora.get_gt_not_ready_0_count();
-            local_gt_not_ready_1_count[repetition] = aurora.get_gt_not_ready_1_count();
-            local_gt_not_ready_2_count[repetition] = aurora.get_gt_not_ready_2_count();
-            local_gt_not_ready_3_count[repetition] = aurora.get_gt_not_ready_3_count();
+        aurora.reset_counter();
+   }
 
-            local_line_down_0_count[repetition] = aurora.get_line_down_0_count();
-            local_line_down_1_count[repetition] = aurora.get_line_down_1_count();
-            local_line_down_2_count[repetition] = aurora.get_line_down_2_count();
-            local_line_down_3_count[repetition] = aurora.get_line_down_3_count();
+    // the snapshots around the transmission of a repetition, the flits,
+    // bytes and cycles are the differences of both
+    void snapshot_begin()
+    {
+        aurora.snapshot();
+        snapshot_start.tx_count = aurora.get_snapshot_tx_count();
+        snapshot_start.rx_count = aurora.get_snapshot_rx_count();
+        snapshot_start.tx_bytes = aurora.get_snapshot_tx_bytes();
+        snapshot_start.rx_bytes = aurora.get_snapshot_rx_bytes();
+        snapshot_start.cycles = aurora.get_snapshot_cycle_count();
+    }
 
-            local_pll_not_locked_count[repetition] = aurora.get_pll_not_locked_count();
-            local_mmcm_not_locked_count[repetition] = aurora.get_mmcm_not_locked_count();
-            local_hard_err_count[repetition] = aurora.get_hard_err_count();
-            local_soft_err_count[repetition] = aurora.get_soft_err_count();
+    void snapshot_end(uint32_t repetition)
+    {
+        aurora.snapshot();
+        local_results[repetition].tx_count = aurora.get_snapshot_tx_count() - snapshot_start.tx_count;
+        local_results[repetition].rx_count = aurora.get_snapshot_rx_count() - snapshot_start.rx_count;
+        local_results[repetition].tx_bytes = aurora.get_snapshot_tx_bytes() - snapshot_start.tx_bytes;
+        local_results[repetition].rx_bytes = aurora.get_snapshot_rx_bytes() - snapshot_start.rx_bytes;
+        local_results[repetition].cycles = aurora.get_snapshot_cycle_count() - snapshot_start.cycles;
+    }
 
-            local_channel_down_count[repetition] = aurora.get_channel_down_count();
+    uint32_t num_samples()
+    {
+        return sample_offsets[config.repetitions];
+    }
 
-            if (aurora.has_framing()) {
-                local_frames_received[repetition] = aurora.get_frames_received();
-                local_frames_with_errors[repetition] = aurora.get_frames_with_errors();
+    // converts the cycles recorded by the kernels, the latencies are only
+    // available if the kernels acknowledge every iteration
+    void add_timestamps(uint32_t repetition, const std::vector<uint64_t> &issue_timestamps, const std::vector<uint64_t> &dump_timestamps)
+    {
+        double cycle_time = 1e-6 / config.kernel_frequency_mhz;
+        for (uint32_t n = 0; n < config.iterations_per_message[repetition]; n++) {
+            uint32_t i = sample_offsets[repetition] + n;
+            uint64_t first = issue_timestamps[ISSUE_TIMESTAMPS * n];
+            uint64_t last = issue_timestamps[ISSUE_TIMESTAMPS * n + 1];
+            uint64_t ack = issue_timestamps[ISSUE_TIMESTAMPS * n + 2];
+            if (ack != 0) {
+                local_round_trip_latencies[i] = (ack - first) * cycle_time;
+                local_one_way_latencies[i] = (ack - last) * cycle_time;
             }
-
-            aurora.reset_counter();
+            local_receive_times[i] = (dump_timestamps[DUMP_TIMESTAMPS * n + 1] - dump_timestamps[DUMP_TIMESTAMPS * n] + 1) * cycle_time;
         }
-   }
+    }
 
-    void gather()
+    // the samples of failed repetitions are not taken into account
+    void build_histograms()
     {
-        total_transmission_times.resize(config.repetitions * world_size);
-        MPI_Gather(local_transmission_times.data(), config.repetitions, MPI_DOUBLE, total_transmission_times.data(), config.repetitions, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-
-        total_failed_transmissions.resize(config.repetitions * world_size);
-        MPI_Gather(local_failed_transmissions.data(), config.repetitions, MPI_UNSIGNED, total_failed_transmissions.data(), config.repetitions, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
-
-        total_fifo_rx_overflow_count.resize(config.repetitions * world_size);
-        MPI_Gather(local_fifo_rx_overflow_count.data(), config.repetitions, MPI_UNSIGNED, total_fifo_rx_overflow_count.data(), config.repetitions, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
-
-        total_fifo_tx_overflow_count.resize(config.repetitions * world_size);
-        MPI_Gather(local_fifo_tx_overflow_count.data(), config.repetitions, MPI_UNSIGNED, total_fifo_tx_overflow_count.data(), config.repetitions, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
-
-        total_nfc_full_trigger_count.resize(config.repetitions * world_size);
-        MPI_Gather(local_nfc_full_trigger_count.data(), config.repetitions, MPI_UNSIGNED, total_nfc_full_trigger_count.data(), config.repetitions, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
-
-        total_nfc_empty_trigger_count.resize(config.repetitions * world_size);
-        MPI_Gather(local_nfc_empty_trigger_count.data(), config.repetitions, MPI_UNSIGNED, total_nfc_empty_trigger_count.data(), config.repetitions, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
-
-        total_nfc_latency_count.resize(config.repetitions * world_size);
-        MPI_Gather(local_nfc_latency_count.data(), config.repetitions, MPI_UNSIGNED, total_nfc_latency_count.data(), config.repetitions, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
-
-        total_errors.resize(config.repetitions * world_size);
-        MPI_Gather(local_errors.data(), config.repetitions, MPI_UNSIGNED, total_errors.data(), config.repetitions, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
-
-        total_tx_count.resize(config.repetitions * world_size);
-        MPI_Gather(local_tx_count.data(), config.repetitions, MPI_UNSIGNED, total_tx_count.data(), config.repetitions, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
-
-        total_rx_count.resize(config.repetitions * world_size);
-        MPI_Gather(local_rx_count.data(), config.repetitions, MPI_UNSIGNED, total_rx_count.data(), config.repetitions, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
-
-        total_gt_not_ready_0_count.resize(config.repetitions * world_size);
-        MPI_Gather(local_gt_not_ready_0_count.data(), config.repetitions, MPI_UNSIGNED, total_gt_not_ready_0_count.data(), config.repetitions, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
-
-        total_gt_not_ready_1_count.resize(config.repetitions * world_size);
-        MPI_Gather(local_gt_not_ready_1_count.data(), config.repetitions, MPI_UNSIGNED, total_gt_not_ready_1_count.data(), config.repetitions, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
-
-        total_gt_not_ready_2_count.resize(config.repetitions * world_size);
-        MPI_Gather(local_gt_not_ready_2_count.data(), config.repetitions, MPI_UNSIGNED, total_gt_not_ready_2_count.data(), config.repetitions, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
-
-        total_gt_not_ready_3_count.resize(config.repetitions * world_size);
-        MPI_Gather(local_gt_not_ready_3_count.data(), config.repetitions, MPI_UNSIGNED, total_gt_not_ready_3_count.data(), config.repetitions, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
-
-        total_line_down_0_count.resize(config.repetitions * world_size);
-        MPI_Gather(local_line_down_0_count.data(), config.repetitions, MPI_UNSIGNED, total_line_down_0_count.data(), config.repetitions, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
-
-        total_line_down_1_count.resize(config.repetitions * world_size);
-        MPI_Gather(local_line_down_1_count.data(), config.repetitions, MPI_UNSIGNED, total_line_down_1_count.data(), config.repetitions, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
-
-        total_line_down_2_count.resize(config.repetitions * world_size);
-        MPI_Gather(local_line_down_2_count.data(), config.repetitions, MPI_UNSIGNED, total_line_down_2_count.data(), config.repetitions, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
-
-        total_line_down_3_count.resize(config.repetitions * world_size);
-        MPI_Gather(local_line_down_3_count.data(), config.repetitions, MPI_UNSIGNED, total_line_down_3_count.data(), config.repetitions, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
-
-        total_pll_not_locked_count.resize(config.repetitions * world_size);
-        MPI_Gather(local_pll_not_locked_count.data(), config.repetitions, MPI_UNSIGNED, total_pll_not_locked_count.data(), config.repetitions, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
-
-        total_mmcm_not_locked_count.resize(config.repetitions * world_size);
-        MPI_Gather(local_mmcm_not_locked_count.data(), config.repetitions, MPI_UNSIGNED, total_mmcm_not_locked_count.data(), config.repetitions, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
+        bool acknowledged = config.test_mode < 2;
+        local_round_trip_histograms.assign(config.repetitions, Histogram());
+        local_one_way_histograms.assign(config.repetitions, Histogram());
+        local_receive_histograms.assign(config.repetitions, Histogram());
+        for (uint32_t r = 0; r < config.repetitions; r++) {
+            if (local_results[r].failed_transmissions == 0) {
+                for (uint32_t i = sample_offsets[r]; i < sample_offsets[r + 1]; i++) {
+                    if (acknowledged) {
+                        local_round_trip_histograms[r].add(local_round_trip_latencies[i]);
+                        local_one_way_histograms[r].add(local_one_way_latencies[i]);
+                    }
+                    local_receive_histograms[r].add(local_receive_times[i]);
+                }
+            }
+            double *stats = local_results[r].latency_stats;
+            for (Histogram *histogram: {&local_round_trip_histograms[r], &local_one_way_histograms[r]}) {
+                for (double p: PERCENTILES) {
+                    *stats++ = histogram->percentile(p);
+                }
+                *stats++ = histogram->count ? histogram->max : std::numeric_limits<double>::quiet_NaN();
+            }
+            *stats = local_receive_histograms[r].percentile(50.0);
+        }
+    }
 
-        total_hard_err_count.resize(config.repetitions * world_size);
-        MPI_Gather(local_hard_err_count.data(), config.repetitions, MPI_UNSIGNED, total_hard_err_count.data(), config.repetitions, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
+    // merges the histograms of all ranks on rank 0, with one reduction
+    // for all counts and one for all minima and maxima
+    std::vector<Histogram> reduce(const std::vector<Histogram> &local)
+    {
+        const uint32_t stride = Histogram::NUM_BUCKETS + 1;
+        std::vector<uint64_t> counts(stride * local.size());
+        std::vector<double> extrema(2 * local.size());
+        for (uint32_t h = 0; h < local.size(); h++) {
+            std::copy(local[h].counts.begin(), local[h].counts.end(), counts.begin() + h * stride);
+            counts[h * stride + Histogram::NUM_BUCKETS] = local[h].count;
+            // the minimum is reduced as maximum of the negated values
+            extrema[2 * h] = -local[h].min;
+            extrema[2 * h + 1] = local[h].max;
+        }
 
-        total_soft_err_count.resize(config.repetitions * world_size);
-        MPI_Gather(local_soft_err_count.data(), config.repetitions, MPI_UNSIGNED, total_soft_err_count.data(), config.repetitions, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
+        std::vector<uint64_t> total_counts(counts.size());
+        std::vector<double> total_extrema(extrema.size());
+        MPI_Reduce(counts.data(), total_counts.data(), counts.size(), MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+        MPI_Reduce(extrema.data(), total_extrema.data(), extrema.size(), MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
+        std::vector<Histogram> total(local.size());
+        for (uint32_t h = 0; h < local.size(); h++) {
+            std::copy(total_counts.begin() + h * stride, total_counts.begin() + h * stride + Histogram::NUM_BUCKETS, total[h].counts.begin());
+            total[h].count = total_counts[h * stride + Histogram::NUM_BUCKETS];
+            total[h].min = -total_extrema[2 * h];
+            total[h].max = total_extrema[2 * h + 1];
+        }
+        return total;
+    }
 
-        total_channel_down_count.resize(config.repetitions * world_size);
-        MPI_Gather(local_channel_down_count.data(), config.repetitions, MPI_UNSIGNED, total_channel_down_count.data(), config.repetitions, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
+    void gather()
+    {
+        build_histograms();
 
-        total_frames_received.resize(config.repetitions * world_size);
-        MPI_Gather(local_frames_received.data(), config.repetitions, MPI_UNSIGNED, total_frames_received.data(), config.repetitions, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
+        MPI_Datatype repetition_result_type = create_repetition_result_type();
+        total_results.resize(config.repetitions * world_size);
+        MPI_Gather(local_results.data(), config.repetitions, repetition_result_type, total_results.data(), config.repetitions, repetition_result_type, 0, MPI_COMM_WORLD);
+        MPI_Type_free(&repetition_result_type);
 
-        total_frames_with_errors.resize(config.repetitions * world_size);
-        MPI_Gather(local_frames_with_errors.data(), config.repetitions, MPI_UNSIGNED, total_frames_with_errors.data(), config.repetitions, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
+        std::vector<Histogram> histograms(local_round_trip_histograms);
+        histograms.insert(histograms.end(), local_one_way_histograms.begin(), local_one_way_histograms.end());
+        histograms.insert(histograms.end(), local_receive_histograms.begin(), local_receive_histograms.end());
+        histograms = reduce(histograms);
+        total_round_trip_histograms.assign(histograms.begin(), histograms.begin() + config.repetitions);
+        total_one_way_histograms.assign(histograms.begin() + config.repetitions, histograms.begin() + 2 * config.repetitions);
+        total_receive_histograms.assign(histograms.begin() + 2 * config.repetitions, histograms.end());
 
         total_bdf_raw.resize(BDF_SIZE * world_size);
         MPI_Gather(local_bdf.data(), BDF_SIZE, MPI_CHAR, total_bdf_raw.data(), BDF_SIZE, MPI_CHAR, 0, MPI_COMM_WORLD);
@@ -239,8 +320,8 @@ public:
     uint32_t failed_transmissions()
     {
         uint32_t count = 0;
-        for (const auto errorcode: total_failed_transmissions) {
-            if (errorcode) {
+        for (const auto &result: total_results) {
+            if (result.failed_transmissions) {
                 count++;
             }
         }
@@ -250,8 +331,8 @@ public:
     uint32_t byte_errors()
     {
         uint32_t count = 0;
-        for (const auto errors: total_errors) {
-            count += errors;
+        for (const auto &result: total_results) {
+            count += result.errors;
         }
         return count;
     }
@@ -259,8 +340,8 @@ public:
     uint32_t frame_errors()
     {
         uint32_t count = 0;
-        for (const auto errors: total_frames_with_errors) {
-            count += errors;
+        for (const auto &result: total_results) {
+            count += result.frames_with_errors;
         }
         return count;
     }
@@ -268,8 +349,8 @@ public:
     uint32_t fifo_rx_overflows()
     {
         uint32_t count = 0;
-        for (const auto overflows: total_fifo_rx_overflow_count) {
-            count += overflows;
+        for (const auto &result: total_results) {
+            count += result.fifo_rx_overflow_count;
         }
         return count;
     }
@@ -277,8 +358,8 @@ public:
     uint32_t nfc_errors()
     {
         uint32_t count = 0;
-        for (uint32_t i = 0; i < total_nfc_full_trigger_count.size(); i++) {
-            count += (total_nfc_full_trigger_count[i] - total_nfc_empty_trigger_count[i]);
+        for (const auto &result: total_results) {
+            count += (result.nfc_full_trigger_count - result.nfc_empty_trigger_count);
         }
         return count;
     }
@@ -300,9 +381,9 @@ public:
 
     void print_results()
     {
-        std::cout << std::setw(36) << "Config" << std::setw(25) << "|"
+        std::cout << std::setw(42) << "Config" << std::setw(31) << "|"
                   << std::setw(24) << "Latency (s)" << std::setw(12) << "|"
-                  << std::setw(27) << "Throughput (Gbit/s)" << std::setw(9) << "|"
+                  << std::setw(33) << "Throughput (Gbit/s)" << std::setw(15) << "|"
                   << std::setw(27) << "Counts per iteration" << std::setw(9) << "|"
                   << std::setw(24) << "Flow Control"
                   << std::endl
@@ -311,12 +392,14 @@ public:
                   << std::setw(12) << "Iterations"
                   << std::setw(12) << "Frame Size"
                   << std::setw(12) << "Bytes"
+                  << std::setw(12) << "Data"
                   << "|" << std::setw(11) << "Min."
                   << std::setw(12) << "Avg."
                   << std::setw(12) << "Max."
                   << "|" << std::setw(11) << "Min."
                   << std::setw(12) << "Avg."
                   << std::setw(12) << "Max."
+                  << std::setw(12) << "Link"
                   << "|" << std::setw(11) << "TX"
                   << std::setw(12) << "RX"
                   << std::setw(12) << "Frames"
@@ -324,7 +407,7 @@ public:
                   << std::setw(12) << "Latency"
                   << std::setw(12) << "TX Stalls"
                   << std::endl
-                  << std::setw(204) << std::setfill('-') << "-"
+                  << std::setw(228) << std::setfill('-') << "-"
                   << std::endl << std::setfill(' ');
 
         for (uint32_t r = 0; r < config.repetitions; r++) {
@@ -339,8 +422,10 @@ public:
             uint64_t nfc_full_triggered_sum = 0;
             uint64_t nfc_max_latency = 0;
             uint64_t fifo_tx_stalls_sum = 0;
+            // received bytes over the cycles between the snapshots
+            double link_gigabits_sum = 0.0;
             for (int32_t i = 0; i < world_size; i++) {
-                double latency = total_transmission_times[i * config.repetitions + r] / config.iterations_per_message[r];
+                double latency = total_results[i * config.repetitions + r].transmission_time / config.iterations_per_message[r];
                 latency_sum += latency;
                 if (latency < latency_min) {
                     latency_min = latency;
@@ -349,14 +434,18 @@ public:
                     latency_max = latency;
                 }
 
-                tx_count_sum += total_tx_count[i * config.repetitions + r];
-                rx_count_sum += total_rx_count[i * config.repetitions + r];
-                frame_count_sum += total_frames_received[i * config.repetitions + r];
-                nfc_full_triggered_sum += total_nfc_full_trigger_count[i * config.repetitions + r];
-                if (total_nfc_latency_count[i * config.repetitions + r] > nfc_max_latency) {
-                    nfc_max_latency = total_nfc_latency_count[i * config.repetitions + r]; 
+                tx_count_sum += total_results[i * config.repetitions + r].tx_count;
+                rx_count_sum += total_results[i * config.repetitions + r].rx_count;
+                frame_count_sum += total_results[i * config.repetitions + r].frames_received;
+                nfc_full_triggered_sum += total_results[i * config.repetitions + r].nfc_full_trigger_count;
+                if (total_results[i * config.repetitions + r].nfc_latency_count > nfc_max_latency) {
+                    nfc_max_latency = total_results[i * config.repetitions + r].nfc_latency_count; 
+                }
+                fifo_tx_stalls_sum += total_results[i * config.repetitions + r].fifo_tx_overflow_count;
+                if (total_results[i * config.repetitions + r].cycles > 0) {
+                    double link_time = total_results[i * config.repetitions + r].cycles / (config.kernel_frequency_mhz * 1e6);
+                    link_gigabits_sum += 8 * total_results[i * config.repetitions + r].rx_bytes / 1000000000.0 / link_time;
                 }
-                fifo_tx_stalls_sum += total_fifo_tx_overflow_count[i * config.repetitions + r];
             }
             double latency_avg = latency_sum / world_size;
             std::cout << std::setw(12) << r
@@ -364,12 +453,14 @@ public:
                       << std::setw(12) << config.iterations_per_message[r]
                       << std::setw(12) << config.frame_sizes[r]
                       << std::setw(12) << config.message_sizes[r]
+                      << std::setw(12) << config.data_path(r)
                       << std::setw(12) << latency_min
                       << std::setw(12) << latency_avg
                       << std::setw(12) << latency_max
                       << std::setw(12) << gigabits_per_iteration / latency_max
                       << std::setw(12) << gigabits_per_iteration / latency_avg
                       << std::setw(12) << gigabits_per_iteration / latency_min
+                      << std::setw(12) << link_gigabits_sum / world_size
                       << std::setw(12) << tx_count_sum / config.iterations_per_message[r] / world_size
                       << std::setw(12) << rx_count_sum / config.iterations_per_message[r] / world_size
                       << std::setw(12) << frame_count_sum / config.iterations_per_message[r] / world_size
@@ -380,6 +471,57 @@ public:
         }
     }
 
+    void print_timestamps()
+    {
+        bool acknowledged = config.test_mode < 2;
+        std::cout << std::endl << "Measured in the kernels with " << config.kernel_frequency_mhz << " MHz";
+        if (!acknowledged) {
+            std::cout << ", latencies are only available with acknowledgements";
+        }
+        std::cout << std::endl
+                  << std::setw(24) << " "
+                  << "|" << std::setw(47) << "Round trip latency (us)"
+                  << "|" << std::setw(47) << "One way latency (us)"
+                  << "|" << std::setw(23) << "Receive (Gbit/s)"
+                  << std::endl
+                  << std::setw(12) << "Repetition"
+                  << std::setw(12) << "Bytes";
+        for (uint32_t i = 0; i < 2; i++) {
+            std::cout << "|" << std::setw(11) << "p50"
+                      << std::setw(12) << "p99"
+                      << std::setw(12) << "p99.9"
+                      << std::setw(12) << "Max.";
+        }
+        std::cout << "|" << std::setw(11) << "p50"
+                  << std::setw(12) << "Min."
+                  << std::endl
+                  << std::setw(146) << std::setfill('-') << "-"
+                  << std::endl << std::setfill(' ');
+
+        for (uint32_t r = 0; r < config.repetitions; r++) {
+            std::cout << std::setw(12) << r
+                      << std::setw(12) << config.message_sizes[r];
+            if (total_receive_histograms[r].count == 0) {
+                std::cout << std::setw(12) << "failed" << std::endl;
+                continue;
+            }
+            for (Histogram *histogram: {&total_round_trip_histograms[r], &total_one_way_histograms[r]}) {
+                if (acknowledged) {
+                    for (double p: PERCENTILES) {
+                        std::cout << std::setw(12) << histogram->percentile(p) * 1e6;
+                    }
+                    std::cout << std::setw(12) << histogram->max * 1e6;
+                } else {
+                    std::cout << std::setw(48) << " ";
+                }
+            }
+            const double gigabits = 8 * config.message_sizes[r] / 1000000000.0;
+            std::cout << std::setw(12) << gigabits / total_receive_histograms[r].percentile(50.0)
+                      << std::setw(12) << gigabits / total_receive_histograms[r].max
+                      << std::endl;
+        }
+    }
+
     void print_errors()
     {
         std::cout << std::endl 
@@ -429,27 +571,27 @@ public:
             uint32_t soft_err_sum = 0;
             uint32_t channel_down_sum = 0;
             for (int32_t i = 0; i < world_size; i++) {
-                if (total_failed_transmissions[i * config.repetitions + r] > 0) {
+                if (total_results[i * config.repetitions + r].failed_transmissions > 0) {
                     failed_transmissions_sum++;
                 }
-                byte_errors_sum += total_errors[i * config.repetitions + r];
-                frame_errors_sum += total_frames_with_errors[i * config.repetitions + r];
-                fifo_rx_errors_sum += total_fifo_rx_overflow_count[i * config.repetitions + r];
-                nfc_full_trigger_sum += total_nfc_full_trigger_count[i * config.repetitions + r];
-                nfc_empty_trigger_sum += total_nfc_empty_trigger_count[i * config.repetitions + r];
-                gt_not_ready_0_sum += total_gt_not_ready_0_count[i * config.repetitions + r];
-                gt_not_ready_1_sum += total_gt_not_ready_1_count[i * config.repetitions + r];
-                gt_not_ready_2_sum += total_gt_not_ready_2_count[i * config.repetitions + r];
-                gt_not_ready_3_sum += total_gt_not_ready_3_count[i * config.repetitions + r];
-                line_down_0_sum += total_line_down_0_count[i * config.repetitions + r];
-                line_down_1_sum += total_line_down_1_count[i * config.repetitions + r];
-                line_down_2_sum += total_line_down_2_count[i * config.repetitions + r];
-                line_down_3_sum += total_line_down_3_count[i * config.repetitions + r];
-                pll_not_locked_sum += total_pll_not_locked_count[i * config.repetitions + r];
-                mmcm_not_locked_sum += total_pll_not_locked_count[i * config.repetitions + r];
-                hard_err_sum += total_hard_err_count[i * config.repetitions + r];
-                soft_err_sum += total_soft_err_count[i * config.repetitions + r];
-                channel_down_sum += total_channel_down_count[i * config.repetitions + r];
+                byte_errors_sum += total_results[i * config.repetitions + r].errors;
+                frame_errors_sum += total_results[i * config.repetitions + r].frames_with_errors;
+                fifo_rx_errors_sum += total_results[i * config.repetitions + r].fifo_rx_overflow_count;
+                nfc_full_trigger_sum += total_results[i * config.repetitions + r].nfc_full_trigger_count;
+                nfc_empty_trigger_sum += total_results[i * config.repetitions + r].nfc_empty_trigger_count;
+                gt_not_ready_0_sum += total_results[i * config.repetitions + r].gt_not_ready_0_count;
+                gt_not_ready_1_sum += total_results[i * config.repetitions + r].gt_not_ready_1_count;
+                gt_not_ready_2_sum += total_results[i * config.repetitions + r].gt_not_ready_2_count;
+                gt_not_ready_3_sum += total_results[i * config.repetitions + r].gt_not_ready_3_count;
+                line_down_0_sum += total_results[i * config.repetitions + r].line_down_0_count;
+                line_down_1_sum += total_results[i * config.repetitions + r].line_down_1_count;
+                line_down_2_sum += total_results[i * config.repetitions + r].line_down_2_count;
+                line_down_3_sum += total_results[i * config.repetitions + r].line_down_3_count;
+                pll_not_locked_sum += total_results[i * config.repetitions + r].pll_not_locked_count;
+                mmcm_not_locked_sum += total_results[i * config.repetitions + r].pll_not_locked_count;
+                hard_err_sum += total_results[i * config.repetitions + r].hard_err_count;
+                soft_err_sum += total_results[i * config.repetitions + r].soft_err_count;
+                channel_down_sum += total_results[i * config.repetitions + r].channel_down_count;
 
             }
             std::cout << std::setw(12) << r
@@ -531,32 +673,48 @@ public:
                    << config.message_sizes[r] << ","
                    << config.iterations_per_message[r] << ","
                    << config.test_nfc << ","
-                   << total_transmission_times[core * config.repetitions + r] << ","
-                   << total_rx_count[core * config.repetitions + r] << ","
-                   << total_tx_count[core * config.repetitions + r] << ","
-                   << total_failed_transmissions[core * config.repetitions + r] << ","
-                   << total_fifo_rx_overflow_count[core * config.repetitions + r] << ","
-                   << total_fifo_tx_overflow_count[core * config.repetitions + r] << ","
-                   << total_nfc_full_trigger_count[core * config.repetitions + r] << ","
-                   << total_nfc_empty_trigger_count[core * config.repetitions + r] << ","
-                   << total_nfc_latency_count[core * config.repetitions + r] << ","
-                   << total_errors[core * config.repetitions + r] << ","
-                   << total_gt_not_ready_0_count[core * config.repetitions + r] << ","
-                   << total_gt_not_ready_1_count[core * config.repetitions + r] << ","
-                   << total_gt_not_ready_2_count[core * config.repetitions + r] << ","
-                   << total_gt_not_ready_3_count[core * config.repetitions + r] << ","
-                   << total_line_down_0_count[core * config.repetitions + r] << ","
-                   << total_line_down_1_count[core * config.repetitions + r] << ","
-                   << total_line_down_2_count[core * config.repetitions + r] << ","
-                   << total_line_down_3_count[core * config.repetitions + r] << ","
-                   << total_pll_not_locked_count[core * config.repetitions + r] << ","
-                   << total_mmcm_not_locked_count[core * config.repetitions + r] << ","
-                   << total_hard_err_count[core * config.repetitions + r] << ","
-                   << total_soft_err_count[core * config.repetitions + r] << ","
-                   << total_channel_down_count[core * config.repetitions + r] << ","
-                   << total_frames_received[core * config.repetitions + r] << ","
-                   << total_frames_with_errors[core * config.repetitions + r]
-                   << std::endl;
+                   << total_results[core * config.repetitions + r].transmission_time << ","
+                   << total_results[core * config.repetitions + r].rx_count << ","
+                   << total_results[core * config.repetitions + r].tx_count << ","
+                   << total_results[core * config.repetitions + r].failed_transmissions << ","
+                   << total_results[core * config.repetitions + r].fifo_rx_overflow_count << ","
+                   << total_results[core * config.repetitions + r].fifo_tx_overflow_count << ","
+                   << total_results[core * config.repetitions + r].nfc_full_trigger_count << ","
+                   << total_results[core * config.repetitions + r].nfc_empty_trigger_count << ","
+                   << total_results[core * config.repetitions + r].nfc_latency_count << ","
+                   << total_results[core * config.repetitions + r].errors << ","
+                   << total_results[core * config.repetitions + r].gt_not_ready_0_count << ","
+                   << total_results[core * config.repetitions + r].gt_not_ready_1_count << ","
+                   << total_results[core * config.repetitions + r].gt_not_ready_2_count << ","
+                   << total_results[core * config.repetitions + r].gt_not_ready_3_count << ","
+                   << total_results[core * config.repetitions + r].line_down_0_count << ","
+                   << total_results[core * config.repetitions + r].line_down_1_count << ","
+                   << total_results[core * config.repetitions + r].line_down_2_count << ","
+                   << total_results[core * config.repetitions + r].line_down_3_count << ","
+                   << total_results[core * config.repetitions + r].pll_not_locked_count << ","
+                   << total_results[core * config.repetitions + r].mmcm_not_locked_count << ","
+                   << total_results[core * config.repetitions + r].hard_err_count << ","
+                   << total_results[core * config.repetitions + r].soft_err_count << ","
+                   << total_results[core * config.repetitions + r].channel_down_count << ","
+                   << total_results[core * config.repetitions + r].frames_received << ","
+                   << total_results[core * config.repetitions + r].frames_with_errors << ","
+                   << config.data_path(r);
+                for (uint32_t i = 0; i < LATENCY_STATS; i++) {
+                    of << "," << total_results[core * config.repetitions + r].latency_stats[i];
+                }
+                of << "," << total_results[core * config.repetitions + r].tx_stall_count
+                   << "," << total_results[core * config.repetitions + r].rx_stall_count
+                   << "," << total_results[core * config.repetitions + r].nfc_xoff_count
+                   << "," << total_results[core * config.repetitions + r].idle_count
+                   << "," << total_results[core * config.repetitions + r].nfc_latency_bound
+                   << "," << total_results[core * config.repetitions + r].fifo_rx_fill_bound
+                   << "," << total_results[core * config.repetitions + r].nfc_full_threshold
+                   << "," << total_results[core * config.repetitions + r].nfc_empty_threshold
+                   << "," << total_results[core * config.repetitions + r].nfc_pause_step
+                   << "," << total_results[core * config.repetitions + r].tx_bytes
+                   << "," << total_results[core * config.repetitions + r].rx_bytes
+                   << "," << total_results[core * config.repetitions + r].cycles;
+                of << std::endl;
             }
         }
         of.close();
@@ -26,10 +26,13 @@
 #include <iostream>
 #include <filesystem>
 #include <fstream>
+#include <future>
 
 #include "Configuration.hpp"
-#include "Results.hpp"
 #include "Kernel.hpp"
+#include "Histogram.hpp"
+#include "Results.hpp"
+#include "../hls/prng.hpp"
 
 void wait_for_enter()
 {
@@ -62,22 +65,53 @@ void check_core_status_global(Aurora &aurora, size_t timeout_ms, int world_rank,
     }
 }
 
-std::vector<std::vector<char>> generate_data(uint32_t num_bytes, uint32_t world_size)
+uint64_t data_seed(uint32_t rank)
 {
     char *slurm_job_id = std::getenv("SLURM_JOB_ID");
+    return (slurm_job_id == NULL) ? rank : (rank + ((uint64_t)std::stoi(slurm_job_id)));
+}
+
+// same data as generated by the kernels, only for the given ranks
+std::vector<std::vector<char>> generate_data(uint32_t num_bytes, uint32_t world_size, const std::vector<uint32_t> &ranks)
+{
     std::vector<std::vector<char>> data;
     data.resize(world_size);
-    for (uint32_t r = 0; r < world_size; r++) {
-        unsigned int seed = (slurm_job_id == NULL) ? r : (r + ((unsigned int)std::stoi(slurm_job_id)));
-        srand(seed);
+    for (uint32_t r: ranks) {
+        if (!data[r].empty()) {
+            continue;
+        }
+        uint64_t seed = data_seed(r);
         data[r].resize(num_bytes);
-        for (uint32_t b = 0; b < num_bytes; b++) {
-            data[r][b] = rand() % 256;
+        char *rank_data = data[r].data();
+        // every word is independent of the others
+        #pragma omp parallel for
+        for (uint32_t w = 0; w < num_bytes / sizeof(uint64_t); w++) {
+            uint64_t word = prng_word(seed, w);
+            memcpy(rank_data + w * sizeof(uint64_t), &word, sizeof(uint64_t));
         }
     }
     return data;
 }
 
+// rank of the issue kernel sending to the dump kernel of this rank
+uint32_t get_issue_rank(uint32_t test_mode, uint32_t world_rank, uint32_t world_size)
+{
+    if (test_mode == 1) {
+        // pair
+        return (world_rank % 2) == 0 ? world_rank + 1 : world_rank - 1;
+    } else if (test_mode == 2) {
+        // ring
+        return (world_rank % 2) == 0 ? (world_rank + world_size - 1) % world_size : (world_rank + 1) % world_size;
+    } else if (test_mode == 4) {
+        // bonded pair, or a loopback between both cores with a single rank
+        if (world_size == 1) {
+            return world_rank;
+        }
+        return (world_rank % 2) == 0 ? world_rank + 1 : world_rank - 1;
+    }
+    return world_rank;
+}
+
 int main(int argc, char *argv[])
 {
     Configuration config(argc, argv);
@@ -97,9 +131,13 @@ int main(int argc, char *argv[])
 
     bool emulation = (std::getenv("XCL_EMULATION_MODE") != nullptr);
 
-    uint32_t device_id = emulation ? 0 : (((node_rank / 2) + config.device_id_offset) % 3);
+    // in the bonded mode every rank drives both cores of an fpga
+    bool bonded = (config.test_mode == 4);
+    uint32_t ranks_per_device = bonded ? 1 : 2;
+
+    uint32_t device_id = emulation ? 0 : (((node_rank / ranks_per_device) + config.device_id_offset) % 3);
 
-    uint32_t instance = node_rank % 2;
+    uint32_t instance = bonded ? 0 : node_rank % 2;
 
     xrt::device device = xrt::device(device_id);
     xrt::uuid xclbin_uuid = device.load_xclbin(config.xclbin_file);
@@ -108,13 +146,47 @@ int main(int argc, char *argv[])
         wait_for_enter();
     }
 
-    Aurora aurora;
+    // the second core is only used in the bonded mode, the counters
+    // in the results are the ones of the first core
+    Aurora aurora, aurora_1;
     if (!emulation) {
         aurora = Aurora(instance, device, xclbin_uuid);
-        check_core_status_global(aurora, config.timeout_ms, world_rank, world_size);
-        config.finish_setup(aurora.fifo_width, aurora.has_framing(), emulation);
+        if (bonded) {
+            aurora_1 = Aurora(1, device, xclbin_uuid);
+        }
     } else {
-        config.finish_setup(64, false, emulation);
+        // the emulation connects issue and dump directly, so only the
+        // registers of the aurora core are modeled
+        aurora = Aurora(std::make_shared<EmulatedAuroraRegisters>());
+        if (bonded) {
+            aurora_1 = Aurora(std::make_shared<EmulatedAuroraRegisters>());
+        }
+    }
+    std::vector<Aurora *> cores = {&aurora};
+    if (bonded) {
+        cores.push_back(&aurora_1);
+    }
+    for (Aurora *core: cores) {
+        check_core_status_global(*core, config.timeout_ms, world_rank, world_size);
+    }
+    // the issue and dump kernels of the bonded design move the flits of both cores at once
+    uint32_t kernel_width = bonded ? 2 * aurora.fifo_width : aurora.fifo_width;
+    config.finish_setup(kernel_width, aurora.has_framing(), emulation);
+
+    if (config.nfc_full_threshold != 0) {
+        if (config.nfc_full_threshold >= aurora.fifo_depth) {
+            std::cerr << "Error: NFC full threshold must be below the fifo depth " << aurora.fifo_depth << std::endl;
+            exit(1);
+        }
+        for (Aurora *core: cores) {
+            core->set_nfc_thresholds(config.nfc_full_threshold, config.nfc_empty_threshold);
+        }
+    }
+
+    if (config.nfc_pause_step >= 0) {
+        for (Aurora *core: cores) {
+            core->set_nfc_pause_mode(config.nfc_pause_step, config.nfc_pause_quanta);
+        }
     }
 
     if (world_rank == 0) {
@@ -122,18 +194,57 @@ int main(int argc, char *argv[])
         std::cout << "with " << world_size << " instances" << std::endl;
     }
 
-    std::vector<std::vector<char>> data = generate_data(config.max_num_bytes, world_size);
+    // the own data for the issue kernel and the data of the sender for verification
+    uint32_t issue_rank = get_issue_rank(config.test_mode, world_rank, world_size);
+    std::vector<std::vector<char>> data = generate_data(config.max_num_bytes, world_size, {(uint32_t)world_rank, issue_rank});
 
     // create kernel objects
-    IssueKernel issue(world_rank, device, xclbin_uuid, config, data[world_rank]);
-    DumpKernel dump(world_rank, device, xclbin_uuid, config);
+    IssueKernel issue(world_rank, instance, device, xclbin_uuid, config, data[world_rank], data_seed(world_rank));
+    DumpKernel dump(world_rank, instance, device, xclbin_uuid, config, data_seed(issue_rank));
+    // with a single rank, core 0 is cabled to core 1 and receives the odd flits
+    std::unique_ptr<BondKernels> bond;
+    if (bonded) {
+        bond = std::make_unique<BondKernels>(device, xclbin_uuid, config, world_size == 1);
+    }
 
     Results results(config, aurora, emulation, device, world_size);
 
+    auto verify = [&](uint32_t r) -> uint32_t {
+        dump.write_back(r);
+        if (config.test_mode < 3 || bonded) {
+            return dump.compare_data(data[issue_rank].data(), r);
+        } else {
+            // no validation
+            return 0;
+        }
+    };
+
+    // verification of the repetitions in flight, one per buffer of the dump kernel
+    std::vector<std::future<uint32_t>> verifications(config.pipeline_depth);
+    auto finish_verification = [&](uint32_t r) {
+        std::future<uint32_t> &verification = verifications[dump.buffer(r)];
+        if (!verification.valid()) {
+            return;
+        }
+        try {
+            results.local_results[r].errors = verification.get();
+        } catch (const std::exception &e) {
+            std::cout << "caught error while verifying repetition " << r << ": " << e.what() << std::endl;
+            results.local_results[r].failed_transmissions = 3;
+        }
+    };
+
     for (uint32_t r = 0; r < config.repetitions; r++) {
+        if (r >= config.pipeline_depth) {
+            // the buffer of the dump kernel is reused
+            finish_verification(r - config.pipeline_depth);
+        }
         try {
             issue.prepare_repetition(r);
             dump.prepare_repetition(r);
+            if (bond) {
+                bond->prepare_repetition(r);
+            }
 
             if (config.test_nfc) {
                 if (world_rank == 0) {
@@ -149,9 +260,13 @@ int main(int argc, char *argv[])
             }
             MPI_Barrier(MPI_COMM_WORLD);        
             
+            if (bond) {
+                bond->start();
+            }
             dump.start();
 
             MPI_Barrier(MPI_COMM_WORLD);
+            results.snapshot_begin();
             double start_time = get_wtime();
 
             if (!config.test_nfc) {
@@ -160,44 +275,51 @@ int main(int argc, char *argv[])
 
             if (dump.timeout()) {
                 std::cout << "Dump timeout" << std::endl;
-                results.local_failed_transmissions[r] = 1;
+                results.local_results[r].failed_transmissions = 1;
             } else {
-                results.local_failed_transmissions[r] = 0;
+                results.local_results[r].failed_transmissions = 0;
             }
             if (issue.timeout()) {
                 std::cout << "Issue timeout" << std::endl;
-                results.local_failed_transmissions[r] = 2;
+                results.local_results[r].failed_transmissions = 2;
+            }
+            if (bond && bond->timeout()) {
+                std::cout << "Stripe/Merge timeout" << std::endl;
+                results.local_results[r].failed_transmissions = 6;
+            } else if (bond && bond->errors() > 0) {
+                std::cout << "Merge lost " << bond->errors() << " blocks" << std::endl;
+                results.local_results[r].failed_transmissions = 7;
             }
 
-            results.local_transmission_times[r] = get_wtime() - start_time;
-            dump.write_back();
-            if (config.test_mode < 3) {
-                uint32_t issue_rank = world_rank;
-                if (config.test_mode == 1) {
-                    // pair
-                    issue_rank = (world_rank % 2) == 0 ? world_rank + 1 : world_rank - 1;
-                } else if (config.test_mode == 2) {
-                    // ring
-                    issue_rank = (world_rank % 2) == 0 ? ((uint32_t)world_rank + world_size - 1) % world_size : ((uint32_t)world_rank + 1) % world_size;
-                }
-                results.local_errors[r] = dump.compare_data(data[issue_rank].data(), r);
+            results.local_results[r].transmission_time = get_wtime() - start_time;
+            results.snapshot_end(r);
+            issue.read_timestamps(r);
+            dump.read_timestamps(r);
+            results.add_timestamps(r, issue.timestamps, dump.timestamps);
+            if (config.pipeline_depth > 1) {
+                // verify while the next repetitions are running
+                verifications[dump.buffer(r)] = std::async(std::launch::async, verify, r);
             } else {
-                // no validation
-                results.local_errors[r] = 0;
+                results.local_results[r].errors = verify(r);
             }
         } catch (const std::runtime_error &e) {
             std::cout << "caught runtime error at repetition " << r << ": " << e.what() << std::endl;
-            results.local_failed_transmissions[r] = 3;
+            results.local_results[r].failed_transmissions = 3;
         } catch (const std::exception &e) {
             std::cout << "caught unexpected error at repetition " << r << ": " << e.what() << std::endl;
-            results.local_failed_transmissions[r] = 4;
+            results.local_results[r].failed_transmissions = 4;
         } catch (...) {
             std::cout << "caught non-std::logic_error at repetition " << r << std::endl;
-            results.local_failed_transmissions[r] = 5;
+            results.local_results[r].failed_transmissions = 5;
         }
         results.update_counter(r);
     }
 
+    uint32_t first_in_flight = config.repetitions > config.pipeline_depth ? config.repetitions - config.pipeline_depth : 0;
+    for (uint32_t r = first_in_flight; r < config.repetitions; r++) {
+        finish_verification(r);
+    }
+
     results.gather();
 
     if (world_rank == 0) {
@@ -221,6 +343,7 @@ int main(int argc, char *argv[])
             }
         }
         results.print_results();
+        results.print_timestamps();
         results.print_errors();
         results.write();
     }
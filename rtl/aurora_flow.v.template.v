@@ -132,6 +132,7 @@ wire            fifo_rx_almost_full_u;
 wire            fifo_rx_prog_full_u;
 wire            fifo_tx_almost_empty_u;
 wire            fifo_tx_prog_empty_u;
+wire [31:0]     fifo_rx_fill_level_u;
 
 wire            fifo_rx_almost_full_sync;
 wire            fifo_rx_prog_full_sync;
@@ -426,6 +427,7 @@ aurora_flow_io aurora_flow_io_0 (
     .fifo_rx_prog_full_u    (fifo_rx_prog_full_u),
     .fifo_rx_almost_empty   (fifo_rx_almost_empty),
     .fifo_rx_prog_empty     (fifo_rx_prog_empty),
+    .fifo_rx_fill_level_u   (fifo_rx_fill_level_u),
     .fifo_tx_almost_full    (fifo_tx_almost_full),
     .fifo_tx_prog_full      (fifo_tx_prog_full),
     .fifo_tx_almost_empty_u (fifo_tx_almost_empty_u),
@@ -473,15 +475,22 @@ wire [31:0] channel_down_count_u;
 
 wire [31:0] fifo_rx_overflow_count_u;
 wire [31:0] fifo_tx_overflow_count;
-wire [31:0] tx_count;
-wire [31:0] rx_count;
+wire [63:0] tx_count;
+wire [63:0] rx_count;
+wire [63:0] tx_bytes;
+wire [63:0] rx_bytes;
+wire [63:0] cycle_count;
+wire [31:0] tx_stall_count;
+wire [31:0] rx_stall_count;
+wire [31:0] nfc_xoff_count_u;
+wire [31:0] idle_count_u;
 
 `ifdef USE_FRAMING
 wire [31:0] frames_received_u;
 wire [31:0] frames_with_errors_u;
 `endif
 
-aurora_flow_monitor aurora_flow_monitor_0 (
+aurora_flow_monitor #(.FLIT_BYTES(`FIFO_WIDTH)) aurora_flow_monitor_0 (
     .rst_u                      (monitor_reset_u),
     .clk_u                      (user_clk),
     .aurora_status              (aurora_status_u),
@@ -500,6 +509,13 @@ aurora_flow_monitor aurora_flow_monitor_0 (
     .hard_err_count             (hard_err_count_u),
     .soft_err_count             (soft_err_count_u),
     .channel_down_count         (channel_down_count_u),
+    .core_tx_tvalid             (s_axi_tx_tvalid_u),
+    .core_rx_tvalid             (m_axi_rx_tvalid_u),
+    .nfc_tvalid                 (s_axi_nfc_tvalid_u),
+    .nfc_tready                 (s_axi_nfc_tready_u),
+    .nfc_tdata                  (s_axi_nfc_tdata_u),
+    .nfc_xoff_count             (nfc_xoff_count_u),
+    .idle_count                 (idle_count_u),
 `ifdef USE_FRAMING
     .crc_valid                  (crc_valid_u),
     .crc_pass_fail_n            (crc_pass_fail_n_u),
@@ -512,10 +528,19 @@ aurora_flow_monitor aurora_flow_monitor_0 (
     .tx_tready                  (tx_axis_tready),
     .rx_tvalid                  (rx_axis_tvalid),
     .rx_tready                  (rx_axis_tready),
+`ifdef USE_FRAMING
+    .tx_tkeep                   (tx_axis_tkeep),
+    .rx_tkeep                   (rx_axis_tkeep),
+`endif
     .fifo_tx_almost_full        (fifo_tx_almost_full),
     .fifo_tx_overflow_count     (fifo_tx_overflow_count),
     .tx_count                   (tx_count),
-    .rx_count                   (rx_count)
+    .rx_count                   (rx_count),
+    .tx_bytes                   (tx_bytes),
+    .rx_bytes                   (rx_bytes),
+    .cycle_count                (cycle_count),
+    .tx_stall_count             (tx_stall_count),
+    .rx_stall_count             (rx_stall_count)
 );
 
 wire [31:0] gt_not_ready_0_count;
@@ -631,6 +656,23 @@ xpm_cdc_array_single #(.WIDTH(32)) aurora_monitor_sync_16 (
     .dest_out(fifo_rx_overflow_count)
 );
 
+wire [31:0] nfc_xoff_count;
+wire [31:0] idle_count;
+
+xpm_cdc_array_single #(.WIDTH(32)) aurora_monitor_sync_17 (
+    .src_in(nfc_xoff_count_u),
+    .src_clk(user_clk),
+    .dest_clk(ap_clk),
+    .dest_out(nfc_xoff_count)
+);
+
+xpm_cdc_array_single #(.WIDTH(32)) aurora_monitor_sync_18 (
+    .src_in(idle_count_u),
+    .src_clk(user_clk),
+    .dest_clk(ap_clk),
+    .dest_out(idle_count)
+);
+
 `ifdef USE_FRAMING
 wire [31:0] frames_received;
 wire [31:0] frames_with_errors;
@@ -651,23 +693,71 @@ xpm_cdc_array_single #(.WIDTH(32)) frames_with_errors_sync (
 `endif
 
 
+// xoff and xon are triggered by the fill level of the rx fifo, compared
+// to the thresholds written by the host like prog full and prog empty.
+// They default to the thresholds of the fifo
+wire [31:0] nfc_thresholds;
+wire [31:0] nfc_thresholds_u;
+wire        fifo_rx_nfc_full_u;
+wire        fifo_rx_nfc_empty_u;
+
+xpm_cdc_array_single #(.WIDTH(32)) nfc_thresholds_sync (
+    .src_in(nfc_thresholds),
+    .src_clk(ap_clk),
+    .dest_clk(user_clk),
+    .dest_out(nfc_thresholds_u)
+);
+
+// bit 0 selects pause quanta instead of xoff, bits 12:8 are the log2 of
+// the pause steps in flits
+wire [31:0] nfc_mode;
+wire [31:0] nfc_mode_u;
+wire [63:0] nfc_pause_quanta;
+wire [63:0] nfc_pause_quanta_u;
+
+xpm_cdc_array_single #(.WIDTH(32)) nfc_mode_sync (
+    .src_in(nfc_mode),
+    .src_clk(ap_clk),
+    .dest_clk(user_clk),
+    .dest_out(nfc_mode_u)
+);
+
+xpm_cdc_array_single #(.WIDTH(64)) nfc_pause_quanta_sync (
+    .src_in(nfc_pause_quanta),
+    .src_clk(ap_clk),
+    .dest_clk(user_clk),
+    .dest_out(nfc_pause_quanta_u)
+);
+
+assign fifo_rx_nfc_full_u = (fifo_rx_fill_level_u >= nfc_thresholds_u[31:16]);
+assign fifo_rx_nfc_empty_u = (fifo_rx_fill_level_u <= nfc_thresholds_u[15:0]);
+
 wire [31:0] nfc_full_trigger_count_u;
 wire [31:0] nfc_empty_trigger_count_u; 
 wire [31:0] nfc_latency_count_u;
+wire [511:0] nfc_latency_histogram_u;
+wire [511:0] fifo_rx_fill_histogram_u;
 
 aurora_flow_nfc aurora_flow_nfc_0 (
     .rst_n                  (ap_rst_n_u),
     .counter_reset          (host_monitor_reset_u),
     .clk                    (user_clk),
-    .fifo_rx_prog_full      (fifo_rx_prog_full_u),
-    .fifo_rx_prog_empty     (fifo_rx_prog_empty_u),
+    .fifo_rx_prog_full      (fifo_rx_nfc_full_u),
+    .fifo_rx_prog_empty     (fifo_rx_nfc_empty_u),
     .rx_tvalid              (m_axi_rx_tvalid_u),
+    .fifo_rx_fill_level     (fifo_rx_fill_level_u),
+    .pause_mode             (nfc_mode_u[0]),
+    .pause_step             (nfc_mode_u[12:8]),
+    .pause_quanta           (nfc_pause_quanta_u),
+    .full_threshold         (nfc_thresholds_u[31:16]),
     .s_axi_nfc_tready       (s_axi_nfc_tready_u),
     .s_axi_nfc_tvalid       (s_axi_nfc_tvalid_u),
     .s_axi_nfc_tdata        (s_axi_nfc_tdata_u),
     .full_trigger_count     (nfc_full_trigger_count_u),
     .empty_trigger_count    (nfc_empty_trigger_count_u),
-    .max_latency            (nfc_latency_count_u)
+    .max_latency            (nfc_latency_count_u),
+    .latency_histogram      (nfc_latency_histogram_u),
+    .fill_level_histogram   (fifo_rx_fill_histogram_u)
 );
 
 wire [31:0] nfc_full_trigger_count;
@@ -695,6 +785,23 @@ xpm_cdc_array_single #(.WIDTH(32)) aurora_nfc_sync_2 (
     .dest_out(nfc_latency_count)
 );
 
+wire [511:0] nfc_latency_histogram;
+wire [511:0] fifo_rx_fill_histogram;
+
+xpm_cdc_array_single #(.WIDTH(512)) aurora_nfc_sync_3 (
+    .src_in(nfc_latency_histogram_u),
+    .src_clk(user_clk),
+    .dest_clk(ap_clk),
+    .dest_out(nfc_latency_histogram)
+);
+
+xpm_cdc_array_single #(.WIDTH(512)) aurora_nfc_sync_4 (
+    .src_in(fifo_rx_fill_histogram_u),
+    .src_clk(user_clk),
+    .dest_clk(ap_clk),
+    .dest_out(fifo_rx_fill_histogram)
+);
+
 wire [21:0] configuration;
 wire [31:0] fifo_thresholds;
 
@@ -746,11 +853,23 @@ aurora_flow_control_s_axi axi_control_slave (
   .nfc_empty_trigger_count  (nfc_empty_trigger_count),
   .tx_count                 (tx_count),
   .rx_count                 (rx_count),
+  .tx_bytes                 (tx_bytes),
+  .rx_bytes                 (rx_bytes),
+  .cycle_count              (cycle_count),
   .nfc_latency_count        (nfc_latency_count),
+  .tx_stall_count           (tx_stall_count),
+  .rx_stall_count           (rx_stall_count),
+  .nfc_xoff_count           (nfc_xoff_count),
+  .idle_count               (idle_count),
+  .nfc_latency_histogram    (nfc_latency_histogram),
+  .fifo_rx_fill_histogram   (fifo_rx_fill_histogram),
 `ifdef USE_FRAMING
   .frames_received          (frames_received),
   .frames_with_errors       (frames_with_errors),
 `endif
+  .nfc_thresholds           (nfc_thresholds),
+  .nfc_mode                 (nfc_mode),
+  .nfc_pause_quanta         (nfc_pause_quanta),
   .core_reset               (sw_reset),
   .monitor_reset            (host_monitor_reset)
 );
@@ -42,6 +42,9 @@ module aurora_flow_control_s_axi (
     // control register signals
     output reg          core_reset,
     output reg          monitor_reset,
+    output reg  [31:0]  nfc_thresholds,
+    output reg  [31:0]  nfc_mode,
+    output reg  [63:0]  nfc_pause_quanta,
     input wire  [21:0]  configuration,
     input wire  [31:0]  fifo_thresholds,
     input wire  [12:0]  aurora_status,
@@ -63,9 +66,18 @@ module aurora_flow_control_s_axi (
     input wire  [31:0]  fifo_tx_overflow_count,
     input wire  [31:0]  nfc_full_trigger_count,
     input wire  [31:0]  nfc_empty_trigger_count,
-    input wire  [31:0]  tx_count,
-    input wire  [31:0]  rx_count,
-    input wire  [31:0]  nfc_latency_count
+    input wire  [63:0]  tx_count,
+    input wire  [63:0]  rx_count,
+    input wire  [63:0]  tx_bytes,
+    input wire  [63:0]  rx_bytes,
+    input wire  [63:0]  cycle_count,
+    input wire  [31:0]  nfc_latency_count,
+    input wire  [31:0]  tx_stall_count,
+    input wire  [31:0]  rx_stall_count,
+    input wire  [31:0]  nfc_xoff_count,
+    input wire  [31:0]  idle_count,
+    input wire  [511:0] nfc_latency_histogram,
+    input wire  [511:0] fifo_rx_fill_histogram
 `ifdef USE_FRAMING
    ,input wire  [31:0]  frames_received,
     input wire  [31:0]  frames_with_errors
@@ -103,6 +115,31 @@ localparam
     ADDR_FRAMES_RECEIVED         = 12'h07c,
     ADDR_FRAMES_WITH_ERRORS      = 12'h080,
 `endif
+    ADDR_TX_STALL_COUNT          = 12'h084,
+    ADDR_RX_STALL_COUNT          = 12'h088,
+    ADDR_NFC_XOFF_COUNT          = 12'h08c,
+    ADDR_IDLE_COUNT              = 12'h090,
+    ADDR_NFC_THRESHOLDS          = 12'h094,
+    ADDR_NFC_MODE                = 12'h098,
+    ADDR_NFC_PAUSE_QUANTA_0      = 12'h0a0,
+    ADDR_NFC_PAUSE_QUANTA_1      = 12'h0a4,
+    ADDR_NFC_PAUSE_QUANTA_2      = 12'h0a8,
+    ADDR_NFC_PAUSE_QUANTA_3      = 12'h0ac,
+    // a write latches the 64 bit counters below in the same cycle
+    ADDR_SNAPSHOT                = 12'h0b0,
+    ADDR_SNAP_CYCLE_COUNT_LO     = 12'h0b8,
+    ADDR_SNAP_CYCLE_COUNT_HI     = 12'h0bc,
+    ADDR_SNAP_TX_COUNT_LO        = 12'h0c0,
+    ADDR_SNAP_TX_COUNT_HI        = 12'h0c4,
+    ADDR_SNAP_RX_COUNT_LO        = 12'h0c8,
+    ADDR_SNAP_RX_COUNT_HI        = 12'h0cc,
+    ADDR_SNAP_TX_BYTES_LO        = 12'h0d0,
+    ADDR_SNAP_TX_BYTES_HI        = 12'h0d4,
+    ADDR_SNAP_RX_BYTES_LO        = 12'h0d8,
+    ADDR_SNAP_RX_BYTES_HI        = 12'h0dc,
+    // 16 bins each, see aurora_flow_nfc
+    ADDR_NFC_LATENCY_HISTOGRAM   = 12'h100,
+    ADDR_FIFO_RX_FILL_HISTOGRAM  = 12'h140,
     
     // registers write state machine
     WRIDLE          = 2'd0,
@@ -128,6 +165,12 @@ localparam
     reg  [31:0]     rdata;
     wire            ar_hs;
     wire [11:0]     raddr;
+    // snapshot of the 64 bit counters
+    reg  [63:0]     snapshot_cycle_count;
+    reg  [63:0]     snapshot_tx_count;
+    reg  [63:0]     snapshot_rx_count;
+    reg  [63:0]     snapshot_tx_bytes;
+    reg  [63:0]     snapshot_rx_bytes;
 
 //------------------------AXI protocol control------------------    
     //------------------------AXI write fsm------------------
@@ -181,6 +224,10 @@ localparam
         if (!ARESETn) begin
             core_reset <= 1'b0;
             monitor_reset <= 1'b0;
+            nfc_thresholds <= fifo_thresholds;
+            // xoff and xon, pause steps of 16 flits
+            nfc_mode <= 32'h00000400;
+            nfc_pause_quanta <= {16'd256, 16'd128, 16'd64, 16'd32};
         end else if (w_hs) begin
             case (waddr)
                 ADDR_CORE_RESET: begin
@@ -191,9 +238,44 @@ localparam
                     if (WSTRB[0])
                         monitor_reset <= WDATA[0];
                 end
+                ADDR_NFC_THRESHOLDS: begin
+                    nfc_thresholds <= (WDATA & wmask) | (nfc_thresholds & ~wmask);
+                end
+                ADDR_NFC_MODE: begin
+                    nfc_mode <= (WDATA & wmask) | (nfc_mode & ~wmask);
+                end
+                ADDR_NFC_PAUSE_QUANTA_0: begin
+                    nfc_pause_quanta[15:0] <= (WDATA[15:0] & wmask[15:0]) | (nfc_pause_quanta[15:0] & ~wmask[15:0]);
+                end
+                ADDR_NFC_PAUSE_QUANTA_1: begin
+                    nfc_pause_quanta[31:16] <= (WDATA[15:0] & wmask[15:0]) | (nfc_pause_quanta[31:16] & ~wmask[15:0]);
+                end
+                ADDR_NFC_PAUSE_QUANTA_2: begin
+                    nfc_pause_quanta[47:32] <= (WDATA[15:0] & wmask[15:0]) | (nfc_pause_quanta[47:32] & ~wmask[15:0]);
+                end
+                ADDR_NFC_PAUSE_QUANTA_3: begin
+                    nfc_pause_quanta[63:48] <= (WDATA[15:0] & wmask[15:0]) | (nfc_pause_quanta[63:48] & ~wmask[15:0]);
+                end
             endcase
         end
     end
+
+    // snapshot
+    always @(posedge ACLK) begin
+        if (!ARESETn) begin
+            snapshot_cycle_count <= 0;
+            snapshot_tx_count <= 0;
+            snapshot_rx_count <= 0;
+            snapshot_tx_bytes <= 0;
+            snapshot_rx_bytes <= 0;
+        end else if (w_hs && (waddr == ADDR_SNAPSHOT) && WSTRB[0] && WDATA[0]) begin
+            snapshot_cycle_count <= cycle_count;
+            snapshot_tx_count <= tx_count;
+            snapshot_rx_count <= rx_count;
+            snapshot_tx_bytes <= tx_bytes;
+            snapshot_rx_bytes <= rx_bytes;
+        end
+    end
     
     //------------------------AXI read fsm-------------------
     assign ARREADY = (rstate == RDIDLE);
@@ -300,10 +382,70 @@ localparam
                     rdata <= nfc_latency_count;
                 end
                 ADDR_TX_COUNT: begin
-                    rdata <= tx_count;
+                    rdata <= tx_count[31:0];
                 end
                 ADDR_RX_COUNT: begin
-                    rdata <= rx_count;
+                    rdata <= rx_count[31:0];
+                end
+                ADDR_TX_STALL_COUNT: begin
+                    rdata <= tx_stall_count;
+                end
+                ADDR_RX_STALL_COUNT: begin
+                    rdata <= rx_stall_count;
+                end
+                ADDR_NFC_XOFF_COUNT: begin
+                    rdata <= nfc_xoff_count;
+                end
+                ADDR_IDLE_COUNT: begin
+                    rdata <= idle_count;
+                end
+                ADDR_NFC_THRESHOLDS: begin
+                    rdata <= nfc_thresholds;
+                end
+                ADDR_NFC_MODE: begin
+                    rdata <= nfc_mode;
+                end
+                ADDR_NFC_PAUSE_QUANTA_0: begin
+                    rdata <= nfc_pause_quanta[15:0];
+                end
+                ADDR_NFC_PAUSE_QUANTA_1: begin
+                    rdata <= nfc_pause_quanta[31:16];
+                end
+                ADDR_NFC_PAUSE_QUANTA_2: begin
+                    rdata <= nfc_pause_quanta[47:32];
+                end
+                ADDR_NFC_PAUSE_QUANTA_3: begin
+                    rdata <= nfc_pause_quanta[63:48];
+                end
+                ADDR_SNAP_CYCLE_COUNT_LO: begin
+                    rdata <= snapshot_cycle_count[31:0];
+                end
+                ADDR_SNAP_CYCLE_COUNT_HI: begin
+                    rdata <= snapshot_cycle_count[63:32];
+                end
+                ADDR_SNAP_TX_COUNT_LO: begin
+                    rdata <= snapshot_tx_count[31:0];
+                end
+                ADDR_SNAP_TX_COUNT_HI: begin
+                    rdata <= snapshot_tx_count[63:32];
+                end
+                ADDR_SNAP_RX_COUNT_LO: begin
+                    rdata <= snapshot_rx_count[31:0];
+                end
+                ADDR_SNAP_RX_COUNT_HI: begin
+                    rdata <= snapshot_rx_count[63:32];
+                end
+                ADDR_SNAP_TX_BYTES_LO: begin
+                    rdata <= snapshot_tx_bytes[31:0];
+                end
+                ADDR_SNAP_TX_BYTES_HI: begin
+                    rdata <= snapshot_tx_bytes[63:32];
+                end
+                ADDR_SNAP_RX_BYTES_LO: begin
+                    rdata <= snapshot_rx_bytes[31:0];
+                end
+                ADDR_SNAP_RX_BYTES_HI: begin
+                    rdata <= snapshot_rx_bytes[63:32];
                 end
 `ifdef USE_FRAMING
                 ADDR_FRAMES_RECEIVED: begin
@@ -313,6 +455,14 @@ localparam
                     rdata <= frames_with_errors;
                 end
 `endif
+                default: begin
+                    if ((raddr & 12'hfc0) == ADDR_NFC_LATENCY_HISTOGRAM) begin
+                        rdata <= nfc_latency_histogram[raddr[5:2] * 32 +: 32];
+                    end
+                    if ((raddr & 12'hfc0) == ADDR_FIFO_RX_FILL_HISTOGRAM) begin
+                        rdata <= fifo_rx_fill_histogram[raddr[5:2] * 32 +: 32];
+                    end
+                end
             endcase
         end
     end
@@ -57,6 +57,7 @@ module aurora_flow_io (
     output wire          fifo_rx_prog_full_u,
     output wire          fifo_rx_almost_empty,
     output wire          fifo_rx_prog_empty,
+    output wire [31:0]   fifo_rx_fill_level_u,
 
     output wire          fifo_tx_almost_full,
     output wire          fifo_tx_prog_full,
@@ -87,7 +88,8 @@ axis_data_fifo_rx axis_data_fifo_rx_0 (
   .almost_full      (fifo_rx_almost_full_u),
   .prog_full        (fifo_rx_prog_full_u),
   .almost_empty     (fifo_rx_almost_empty),
-  .prog_empty       (fifo_rx_prog_empty)
+  .prog_empty       (fifo_rx_prog_empty),
+  .axis_wr_data_count (fifo_rx_fill_level_u)
 );
 
 axis_data_fifo_tx axis_data_fifo_tx_0 (
@@ -152,7 +154,8 @@ axis_data_fifo_rx axis_data_fifo_rx_0 (
   .almost_full      (fifo_rx_almost_full_u),
   .prog_full        (fifo_rx_prog_full_u),
   .almost_empty     (fifo_rx_almost_empty),
-  .prog_empty       (fifo_rx_prog_empty)
+  .prog_empty       (fifo_rx_prog_empty),
+  .axis_wr_data_count (fifo_rx_fill_level_u)
 );
 
 axis_dwidth_converter_rx axis_dwidth_converter_rx_0 (
@@ -35,6 +35,13 @@ module aurora_flow_monitor(
     output reg [31:0] hard_err_count,
     output reg [31:0] soft_err_count,
     output reg [31:0] channel_down_count,
+    input wire core_tx_tvalid,
+    input wire core_rx_tvalid,
+    input wire nfc_tvalid,
+    input wire nfc_tready,
+    input wire [15:0] nfc_tdata,
+    output reg [31:0] nfc_xoff_count,
+    output reg [31:0] idle_count,
 `ifdef USE_FRAMING
     input wire crc_valid,
     input wire crc_pass_fail_n,
@@ -48,11 +55,23 @@ module aurora_flow_monitor(
     input wire tx_tready,
     input wire rx_tvalid,
     input wire rx_tready,
+`ifdef USE_FRAMING
+    input wire [63:0] tx_tkeep,
+    input wire [63:0] rx_tkeep,
+`endif
     output reg [31:0] fifo_tx_overflow_count,
-    output reg [31:0] tx_count,
-    output reg [31:0] rx_count
+    output reg [63:0] tx_count,
+    output reg [63:0] rx_count,
+    output reg [63:0] tx_bytes,
+    output reg [63:0] rx_bytes,
+    output reg [63:0] cycle_count,
+    output reg [31:0] tx_stall_count,
+    output reg [31:0] rx_stall_count
 );
 
+// bytes of a flit without tkeep, set to the fifo width
+parameter FLIT_BYTES = 64;
+
 parameter
     GT_POWERGOOD_0  = 13'h0001,
     GT_POWERGOOD_1  = 13'h0002,
@@ -77,6 +96,46 @@ parameter
 
 reg rx_full_triggered, tx_full_triggered;
 
+// bytes of a flit, the set bits of tkeep
+function [6:0] flit_bytes;
+    input [63:0] keep;
+    integer i;
+    begin
+        flit_bytes = 0;
+        for (i = 0; i < FLIT_BYTES; i = i + 1) begin
+            flit_bytes = flit_bytes + keep[i];
+        end
+    end
+endfunction
+
+// without framing, every flit is complete
+wire [63:0] tx_keep, rx_keep;
+
+`ifdef USE_FRAMING
+assign tx_keep = tx_tkeep;
+assign rx_keep = rx_tkeep;
+`else
+assign tx_keep = {64{1'b1}};
+assign rx_keep = {64{1'b1}};
+`endif
+
+// the partner is paused by an xoff until the next xon or for the cycles
+// of a pause message. Not cleared by the counter reset, the pause outlasts it
+reg nfc_xoff = 1'b0;
+reg [15:0] nfc_pause = 16'h0000;
+wire nfc_paused;
+
+assign nfc_paused = nfc_xoff || (nfc_pause != 16'h0000);
+
+always @(posedge clk_u) begin
+    if (nfc_tvalid && nfc_tready) begin
+        nfc_xoff <= (nfc_tdata == 16'hffff);
+        nfc_pause <= (nfc_tdata == 16'hffff) ? 16'h0000 : nfc_tdata;
+    end else if (nfc_pause != 16'h0000) begin
+        nfc_pause <= nfc_pause - 1;
+    end
+end
+
 always @(posedge clk_u) begin
     if (rst_u) begin
         gt_not_ready_0_count <= 0;
@@ -94,6 +153,8 @@ always @(posedge clk_u) begin
         channel_down_count <= 0;
         fifo_rx_overflow_count <= 0;
         rx_full_triggered <= fifo_rx_almost_full;
+        nfc_xoff_count <= 0;
+        idle_count <= 0;
 `ifdef USE_FRAMING
         frames_received <= 0;
         frames_with_errors <= 0;
@@ -152,6 +213,14 @@ always @(posedge clk_u) begin
         else if (!fifo_rx_almost_full && rx_full_triggered) begin
             rx_full_triggered <= 1'b0;
         end
+
+        if (nfc_paused) begin
+            nfc_xoff_count <= nfc_xoff_count + 1;
+        end
+        // channel up, but no data in either direction
+        if ((aurora_status & CHANNEL_UP) && !core_tx_tvalid && !core_rx_tvalid) begin
+            idle_count <= idle_count + 1;
+        end
         
 `ifdef USE_FRAMING
         if (crc_valid) begin
@@ -170,6 +239,11 @@ always @(posedge clk) begin
         tx_full_triggered <= fifo_tx_almost_full;
         tx_count <= 0;
         rx_count <= 0;
+        tx_bytes <= 0;
+        rx_bytes <= 0;
+        cycle_count <= 0;
+        tx_stall_count <= 0;
+        rx_stall_count <= 0;
     end else begin
         if (fifo_tx_almost_full && !tx_full_triggered) begin
             fifo_tx_overflow_count <= fifo_tx_overflow_count + 1;
@@ -181,9 +255,21 @@ always @(posedge clk) begin
 
         if (tx_tvalid && tx_tready) begin
             tx_count <= tx_count + 1;
+            tx_bytes <= tx_bytes + flit_bytes(tx_keep);
         end
         if (rx_tvalid && rx_tready) begin
             rx_count <= rx_count + 1;
+            rx_bytes <= rx_bytes + flit_bytes(rx_keep);
+        end
+        cycle_count <= cycle_count + 1;
+
+        // the user kernel is blocked by the core
+        if (tx_tvalid && !tx_tready) begin
+            tx_stall_count <= tx_stall_count + 1;
+        end
+        // the user kernel does not consume the received data
+        if (rx_tvalid && !rx_tready) begin
+            rx_stall_count <= rx_stall_count + 1;
         end
     end
 end
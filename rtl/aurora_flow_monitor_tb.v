@@ -23,6 +23,11 @@ module aurora_flow_monitor_tb();
     reg fifo_rx_almost_full;
     reg crc_valid;
     reg crc_pass_fail_n;
+    reg core_tx_tvalid;
+    reg core_rx_tvalid;
+    reg nfc_tvalid;
+    reg nfc_tready;
+    reg [15:0] nfc_tdata;
 
     wire [31:0] gt_not_ready_0_count;
     wire [31:0] gt_not_ready_1_count;
@@ -40,6 +45,8 @@ module aurora_flow_monitor_tb();
     wire [31:0] fifo_rx_overflow_count;
     wire [31:0] frames_received;
     wire [31:0] frames_with_errors;
+    wire [31:0] nfc_xoff_count;
+    wire [31:0] idle_count;
 
     reg rst;
     reg clk;
@@ -48,10 +55,17 @@ module aurora_flow_monitor_tb();
     reg tx_tready;
     reg rx_tvalid;
     reg rx_tready;
+    reg [63:0] tx_tkeep;
+    reg [63:0] rx_tkeep;
 
     wire [31:0] fifo_tx_overflow_count;
-    wire [31:0] tx_count;
-    wire [31:0] rx_count;
+    wire [63:0] tx_count;
+    wire [63:0] rx_count;
+    wire [63:0] tx_bytes;
+    wire [63:0] rx_bytes;
+    wire [63:0] cycle_count;
+    wire [31:0] tx_stall_count;
+    wire [31:0] rx_stall_count;
 
     aurora_flow_monitor dut (
         .clk_u(clk_u),
@@ -72,6 +86,13 @@ module aurora_flow_monitor_tb();
         .soft_err_count(soft_err_count),
         .channel_down_count(channel_down_count),
         .fifo_rx_overflow_count(fifo_rx_overflow_count),
+        .core_tx_tvalid(core_tx_tvalid),
+        .core_rx_tvalid(core_rx_tvalid),
+        .nfc_tvalid(nfc_tvalid),
+        .nfc_tready(nfc_tready),
+        .nfc_tdata(nfc_tdata),
+        .nfc_xoff_count(nfc_xoff_count),
+        .idle_count(idle_count),
         .clk(clk),
         .rst(rst),
         .fifo_tx_almost_full(fifo_tx_almost_full),
@@ -79,9 +100,16 @@ module aurora_flow_monitor_tb();
         .tx_tready(tx_tready),
         .rx_tvalid(rx_tvalid),
         .rx_tready(rx_tready),
+        .tx_tkeep(tx_tkeep),
+        .rx_tkeep(rx_tkeep),
         .fifo_tx_overflow_count(fifo_tx_overflow_count),
         .tx_count(tx_count),
         .rx_count(rx_count),
+        .tx_bytes(tx_bytes),
+        .rx_bytes(rx_bytes),
+        .cycle_count(cycle_count),
+        .tx_stall_count(tx_stall_count),
+        .rx_stall_count(rx_stall_count),
         .crc_valid(crc_valid),
         .crc_pass_fail_n(crc_pass_fail_n),
         .frames_received(frames_received),
@@ -94,11 +122,13 @@ module aurora_flow_monitor_tb();
     end
 
     initial begin
-        clk_u = 1'b0;
-        forever #7 clk_u = ~clk_u;
+        clk = 1'b0;
+        forever #7 clk = ~clk;
     end
 
     reg [15:0] errors;
+    reg [31:0] idle_start;
+    reg [63:0] cycle_start;
 
     initial begin
         $dumpfile("monitor_tb.vcd");
@@ -120,8 +150,14 @@ module aurora_flow_monitor_tb();
         $monitor("fifo_tx_overflow_count = %d", fifo_tx_overflow_count);
         $monitor("tx_count = %d", tx_count);
         $monitor("rx_count = %d", rx_count);
+        $monitor("tx_bytes = %d", tx_bytes);
+        $monitor("rx_bytes = %d", rx_bytes);
         $monitor("frames_received = %d", frames_received);
         $monitor("frames_with_errors = %d", frames_with_errors);
+        $monitor("nfc_xoff_count = %d", nfc_xoff_count);
+        $monitor("idle_count = %d", idle_count);
+        $monitor("tx_stall_count = %d", tx_stall_count);
+        $monitor("rx_stall_count = %d", rx_stall_count);
 
         errors = 0;
 
@@ -131,8 +167,15 @@ module aurora_flow_monitor_tb();
         tx_tvalid = 1'b0;
         tx_tready = 1'b0;
         rx_tvalid = 1'b0;
+        tx_tkeep = {64{1'b1}};
+        rx_tkeep = {64{1'b1}};
         crc_valid = 1'b0;
         crc_pass_fail_n = 1'b0;
+        core_tx_tvalid = 1'b0;
+        core_rx_tvalid = 1'b0;
+        nfc_tvalid = 1'b0;
+        nfc_tready = 1'b0;
+        nfc_tdata = 16'h0000;
 
         rst_u = 1'b1;
         rst = 1'b1;
@@ -155,6 +198,9 @@ module aurora_flow_monitor_tb();
             || fifo_tx_overflow_count != 0
             || tx_count != 0
             || rx_count != 0
+            || tx_bytes != 0
+            || rx_bytes != 0
+            || cycle_count != 0
             || frames_received != 0
             || frames_with_errors != 0) begin
             $error(1, "reset did not work");
@@ -306,6 +352,95 @@ module aurora_flow_monitor_tb();
             $error(1, "rx count not correct");
         end
 
+        if (tx_bytes != 3 * 64) begin
+            $error(1, "tx bytes not correct");
+            errors = errors + 1;
+        end
+
+        if (rx_bytes != 5 * 64) begin
+            $error(1, "rx bytes not correct");
+            errors = errors + 1;
+        end
+
+        // the stalled flits end with one handshake each, the tx flit is a
+        // partial one
+        tx_tkeep = 64'h0000_0000_0000_ffff;
+        tx_tvalid = 1'b1;
+        tx_tready = 1'b0;
+        rx_tvalid = 1'b1;
+        rx_tready = 1'b0;
+        repeat (4) @(posedge clk);
+        tx_tready = 1'b1;
+        rx_tready = 1'b1;
+        @(posedge clk);
+        tx_tvalid = 1'b0;
+        rx_tvalid = 1'b0;
+        @(posedge clk);
+
+        if (tx_stall_count != 4) begin
+            $error(1, "tx stall count not correct");
+            errors = errors + 1;
+        end
+
+        if (rx_stall_count != 4) begin
+            $error(1, "rx stall count not correct");
+            errors = errors + 1;
+        end
+
+        tx_tkeep = {64{1'b1}};
+
+        if (tx_bytes != 3 * 64 + 16) begin
+            $error(1, "tx bytes of a partial flit not correct");
+            errors = errors + 1;
+        end
+
+        if (rx_bytes != 6 * 64) begin
+            $error(1, "rx bytes not correct");
+            errors = errors + 1;
+        end
+
+        cycle_start = cycle_count;
+        repeat (10) @(posedge clk);
+        if (cycle_count - cycle_start != 10) begin
+            $error(1, "cycle count not correct");
+            errors = errors + 1;
+        end
+
+        // counted from the cycle after the xoff until the xon is sent
+        nfc_tvalid = 1'b1;
+        nfc_tready = 1'b1;
+        nfc_tdata = 16'hffff;
+        @(posedge clk_u);
+        nfc_tvalid = 1'b0;
+        repeat (3) @(posedge clk_u);
+        nfc_tvalid = 1'b1;
+        nfc_tdata = 16'h0000;
+        @(posedge clk_u);
+        nfc_tvalid = 1'b0;
+        repeat (2) @(posedge clk_u);
+
+        if (nfc_xoff_count != 4) begin
+            $error(1, "nfc xoff count not correct");
+            errors = errors + 1;
+        end
+
+        core_tx_tvalid = 1'b1;
+        @(posedge clk_u);
+        idle_start = idle_count;
+        repeat (3) @(posedge clk_u);
+        core_tx_tvalid = 1'b0;
+        core_rx_tvalid = 1'b1;
+        repeat (3) @(posedge clk_u);
+        core_rx_tvalid = 1'b0;
+        repeat (3) @(posedge clk_u);
+        core_tx_tvalid = 1'b1;
+        @(posedge clk_u);
+
+        if (idle_count != idle_start + 3) begin
+            $error(1, "idle count not correct");
+            errors = errors + 1;
+        end
+
 
  
     end
@@ -16,31 +16,60 @@
 `default_nettype none
 `timescale 1ns/1ps
 
-module aurora_flow_nfc (
+module aurora_flow_nfc #(
+    // log2 histograms: bin 0 counts the zeros, bin b > 0 the values from
+    // 2^(b - 1) to 2^b - 1 and the last bin everything above
+    parameter HISTOGRAM_BINS = 16
+) (
     input wire  rst_n,
     input wire  counter_reset,
     input wire  clk,
     input wire  fifo_rx_prog_full,
     input wire  fifo_rx_prog_empty,
     input wire  rx_tvalid,
+    input wire [31:0] fifo_rx_fill_level,
+    // instead of xoff, pause the partner for a number of cycles from the
+    // quanta table, indexed by the fill level above the full threshold in
+    // steps of 2^pause_step flits, and refresh the pause while still full
+    input wire  pause_mode,
+    input wire [4:0] pause_step,
+    input wire [63:0] pause_quanta,
+    input wire [15:0] full_threshold,
     input wire  s_axi_nfc_tready,
     output reg  s_axi_nfc_tvalid,
     output reg [0:15] s_axi_nfc_tdata,
     output reg [31:0] full_trigger_count,
     output reg [31:0] empty_trigger_count,
-    output reg [31:0] max_latency
+    output reg [31:0] max_latency,
+    output wire [HISTOGRAM_BINS * 32 - 1:0] latency_histogram,
+    output wire [HISTOGRAM_BINS * 32 - 1:0] fill_level_histogram
 );
 
-localparam empty = 3'b000;
-localparam empty_transmit = 3'b001;
-localparam empty_triggered = 3'b010;
-localparam full = 3'b011;
-localparam full_transmit = 3'b100;
-localparam full_triggered = 3'b101;
-localparam idle = 3'b110;
-localparam reset = 3'b111;
+function [3:0] log2_bin(input [31:0] value);
+    integer k;
+    begin
+        log2_bin = 0;
+        for (k = 0; k < HISTOGRAM_BINS - 1; k = k + 1) begin
+            if (value >= (32'd1 << k)) begin
+                log2_bin = k + 1;
+            end
+        end
+    end
+endfunction
 
-reg [2:0] current_state, next_state;
+localparam empty = 4'b0000;
+localparam empty_transmit = 4'b0001;
+localparam empty_triggered = 4'b0010;
+localparam full = 4'b0011;
+localparam full_transmit = 4'b0100;
+localparam full_triggered = 4'b0101;
+localparam idle = 4'b0110;
+localparam reset = 4'b0111;
+localparam pause_triggered = 4'b1000;
+localparam pause_transmit = 4'b1001;
+localparam paused = 4'b1010;
+
+reg [3:0] current_state, next_state;
 
 // default big endian
 reg [0:15] nfc_xoff = 16'hffff;
@@ -48,6 +77,31 @@ reg [0:15] nfc_xon = 16'h0000;
 
 reg [31:0] latency_count;
 
+// pause of the current message and cycles since it was sent, a pause is
+// only counted as a full trigger when the partner was not paused before
+reg [15:0] pause_length;
+reg [15:0] pause_count;
+reg pausing;
+
+wire [31:0] pause_overshoot;
+wire [1:0] pause_index;
+assign pause_overshoot = (fifo_rx_fill_level > full_threshold) ? ((fifo_rx_fill_level - full_threshold) >> pause_step) : 0;
+assign pause_index = (pause_overshoot > 3) ? 2'd3 : pause_overshoot[1:0];
+
+// flits received after an xoff and fill level of the rx fifo every cycle
+reg [31:0] latency_bins [0:HISTOGRAM_BINS - 1];
+reg [31:0] fill_level_bins [0:HISTOGRAM_BINS - 1];
+reg [3:0] fill_level_bin;
+integer i, j;
+
+genvar b;
+generate
+    for (b = 0; b < HISTOGRAM_BINS; b = b + 1) begin : histogram_outputs
+        assign latency_histogram[b * 32 +: 32] = latency_bins[b];
+        assign fill_level_histogram[b * 32 +: 32] = fill_level_bins[b];
+    end
+endgenerate
+
 always @ (posedge clk) begin
     case(current_state)
     reset: begin
@@ -66,6 +120,10 @@ always @ (posedge clk) begin
         full_trigger_count <= 0;
         latency_count <= 0;
         max_latency <= 0;
+        for (i = 0; i < HISTOGRAM_BINS; i = i + 1) begin
+            latency_bins[i] <= 0;
+        end
+        pausing <= 1'b0;
     end
     empty_triggered: begin
         s_axi_nfc_tdata <= nfc_xon;
@@ -104,18 +162,68 @@ always @ (posedge clk) begin
             if (latency_count > max_latency) begin
                 max_latency <= latency_count;
             end
+            latency_bins[log2_bin(latency_count)] <= latency_bins[log2_bin(latency_count)] + 1;
             latency_count <= 0;
         end
         else if (rx_tvalid) begin
             latency_count <= latency_count + 1;
         end
     end
+    pause_triggered: begin
+        s_axi_nfc_tdata <= pause_quanta[pause_index * 16 +: 16];
+        s_axi_nfc_tvalid <= 1'b1;
+        pause_length <= pause_quanta[pause_index * 16 +: 16];
+        pause_count <= 0;
+        next_state = pause_transmit;
+        if (!pausing) begin
+            full_trigger_count <= full_trigger_count + 1;
+            latency_count <= 0;
+            pausing <= 1'b1;
+        end
+    end
+    pause_transmit: begin
+        if (s_axi_nfc_tready) begin
+            s_axi_nfc_tvalid <= 1'b0;
+            next_state = paused;
+        end
+        // like in paused, only flits that still arrive are counted
+        if (rx_tvalid) begin
+            latency_count <= latency_count + 1;
+        end
+    end
+    paused: begin
+        // refreshed after half of the pause, so the partner does not
+        // resume before the next message arrives
+        pause_count <= pause_count + 1;
+        if (rx_tvalid) begin
+            latency_count <= latency_count + 1;
+        end
+        if (pause_count + 1 >= (pause_length >> 1)) begin
+            if (fifo_rx_prog_full) begin
+                next_state = pause_triggered;
+            end
+            else begin
+                next_state = idle;
+                pausing <= 1'b0;
+                if (latency_count > max_latency) begin
+                    max_latency <= latency_count;
+                end
+                latency_bins[log2_bin(latency_count)] <= latency_bins[log2_bin(latency_count)] + 1;
+                latency_count <= 0;
+            end
+        end
+    end
     idle: begin
         if (fifo_rx_prog_empty) begin
             next_state = empty_triggered;
         end
         else if (fifo_rx_prog_full) begin
-            next_state = full_triggered;
+            if (pause_mode) begin
+                next_state = pause_triggered;
+            end
+            else begin
+                next_state = full_triggered;
+            end
         end
     end
     endcase
@@ -131,8 +239,24 @@ always @ (posedge clk) begin
         full_trigger_count <= 0;
         latency_count <= 0;
         max_latency <= 0;
+        for (i = 0; i < HISTOGRAM_BINS; i = i + 1) begin
+            latency_bins[i] <= 0;
+        end
     end
 
 end
 
+// the bin is registered to keep the fill level off the critical path,
+// the counters saturate instead of wrapping around in long runs
+always @ (posedge clk) begin
+    fill_level_bin <= log2_bin(fifo_rx_fill_level);
+    if (!rst_n || counter_reset) begin
+        for (j = 0; j < HISTOGRAM_BINS; j = j + 1) begin
+            fill_level_bins[j] <= 0;
+        end
+    end else if (fill_level_bins[fill_level_bin] != 32'hffffffff) begin
+        fill_level_bins[fill_level_bin] <= fill_level_bins[fill_level_bin] + 1;
+    end
+end
+
 endmodule
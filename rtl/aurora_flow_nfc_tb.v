@@ -27,6 +27,12 @@ module aurora_flow_nfc_tb();
     wire [15:0] s_axi_nfc_tdata;
     reg rx_tvalid;
     wire [31:0] full_trigger_count, empty_trigger_count, max_latency;
+    reg [31:0] fifo_rx_fill_level;
+    wire [511:0] latency_histogram, fill_level_histogram;
+    reg pause_mode;
+    reg [4:0] pause_step;
+    reg [63:0] pause_quanta;
+    reg [15:0] full_threshold;
 
     aurora_flow_nfc dut (
         .clk(clk),
@@ -38,9 +44,16 @@ module aurora_flow_nfc_tb();
         .s_axi_nfc_tvalid(s_axi_nfc_tvalid),
         .s_axi_nfc_tdata(s_axi_nfc_tdata),
         .rx_tvalid(rx_tvalid),
+        .fifo_rx_fill_level(fifo_rx_fill_level),
+        .pause_mode(pause_mode),
+        .pause_step(pause_step),
+        .pause_quanta(pause_quanta),
+        .full_threshold(full_threshold),
         .full_trigger_count(full_trigger_count),
         .empty_trigger_count(empty_trigger_count),
-        .max_latency(max_latency)
+        .max_latency(max_latency),
+        .latency_histogram(latency_histogram),
+        .fill_level_histogram(fill_level_histogram)
     );
 
     initial begin
@@ -48,7 +61,69 @@ module aurora_flow_nfc_tb();
         forever #10 clk = ~clk;
     end
 
+    // link model for comparing xoff and pause quanta: the partner sends a
+    // flit every cycle unless paused, messages and flits arrive after
+    // LINK_DELAY cycles and the consumer takes a flit every second cycle
+    localparam LINK_DELAY = 8;
+    localparam MODEL_FULL = 64;
+    localparam MODEL_EMPTY = 16;
+    localparam MODEL_DEPTH = 128;
+    localparam MODEL_CYCLES = 2000;
+
+    reg model_enable;
+    reg [16:0] nfc_link [0:LINK_DELAY - 1];
+    reg [LINK_DELAY - 1:0] flit_link;
+    reg partner_xoff;
+    reg [15:0] partner_pause;
+    reg [31:0] fill, next_fill, max_fill, consumed, consumed_start, model_cycles;
+    reg arrived, consume;
+    integer k;
+
+    always @(posedge clk) begin
+        if (!model_enable) begin
+            for (k = 0; k < LINK_DELAY; k = k + 1) begin
+                nfc_link[k] <= 0;
+            end
+            flit_link <= 0;
+            partner_xoff <= 1'b0;
+            partner_pause <= 0;
+            fill <= 0;
+            max_fill <= 0;
+            consumed <= 0;
+            model_cycles <= 0;
+        end else begin
+            if (nfc_link[LINK_DELAY - 1][16]) begin
+                partner_xoff <= (nfc_link[LINK_DELAY - 1][15:0] == 16'hffff);
+                partner_pause <= (nfc_link[LINK_DELAY - 1][15:0] == 16'hffff) ? 16'h0000 : nfc_link[LINK_DELAY - 1][15:0];
+            end else if (partner_pause != 0) begin
+                partner_pause <= partner_pause - 1;
+            end
+            for (k = LINK_DELAY - 1; k > 0; k = k - 1) begin
+                nfc_link[k] <= nfc_link[k - 1];
+            end
+            nfc_link[0] <= {s_axi_nfc_tvalid && s_axi_nfc_tready, s_axi_nfc_tdata};
+            flit_link <= {flit_link[LINK_DELAY - 2:0], !partner_xoff && (partner_pause == 0)};
+
+            arrived = flit_link[LINK_DELAY - 1];
+            consume = !model_cycles[0] && (fill != 0);
+            next_fill = fill + arrived - consume;
+            fill <= next_fill;
+            if (next_fill > max_fill) begin
+                max_fill <= next_fill;
+            end
+            consumed <= consumed + consume;
+            model_cycles <= model_cycles + 1;
+
+            // the thresholds are compared like in aurora_flow
+            fifo_rx_fill_level <= next_fill;
+            fifo_rx_prog_full <= (next_fill >= MODEL_FULL);
+            fifo_rx_prog_empty <= (next_fill <= MODEL_EMPTY);
+            rx_tvalid <= arrived;
+        end
+    end
+
     reg [15:0] errors;
+    integer mode;
 
     initial begin
         $dumpfile("nfc_tb.vcd");
@@ -65,6 +140,12 @@ module aurora_flow_nfc_tb();
         fifo_rx_prog_empty = 1'b0;
         s_axi_nfc_tready = 1'b0;
         counter_reset = 1'b0;
+        fifo_rx_fill_level = 0;
+        pause_mode = 1'b0;
+        pause_step = 3;
+        pause_quanta = {16'd128, 16'd64, 16'd32, 16'd16};
+        full_threshold = MODEL_FULL;
+        model_enable = 1'b0;
         rst_n = 1'b0;
         repeat (2) @(posedge clk);
 
@@ -128,13 +209,64 @@ module aurora_flow_nfc_tb();
             errors = errors + 1;
         end
 
+        // both latencies are between 16 and 31
+        if (latency_histogram[5 * 32 +: 32] != 2) begin
+            $error(1, "latency histogram not correct");
+            errors = errors + 1;
+        end
+
+        fifo_rx_fill_level = 100;
+        repeat (10) @(posedge clk);
+        fifo_rx_fill_level = 0;
+        repeat (3) @(posedge clk);
+
+        if (fill_level_histogram[7 * 32 +: 32] != 10) begin
+            $error(1, "fill level histogram not correct");
+            errors = errors + 1;
+        end
+
         counter_reset = 1'b1;
         @(posedge clk);
 
-        if (full_trigger_count != 0 || empty_trigger_count != 0 || max_latency != 0) begin
+        if (full_trigger_count != 0 || empty_trigger_count != 0 || max_latency != 0
+            || latency_histogram != 0 || fill_level_histogram != 0) begin
             $error(1, "counter reset not working");
             errors = errors + 1;
         end
+
+        // sustained throughput and occupancy with xoff and with pause quanta,
+        // the consumer must never starve and the fifo never overflow
+        for (mode = 0; mode < 2; mode = mode + 1) begin
+            rst_n = 1'b0;
+            counter_reset = 1'b0;
+            model_enable = 1'b0;
+            pause_mode = mode;
+            s_axi_nfc_tready = 1'b1;
+            fifo_rx_fill_level = 0;
+            fifo_rx_prog_full = 1'b0;
+            fifo_rx_prog_empty = 1'b1;
+            rx_tvalid = 1'b0;
+            repeat (2) @(posedge clk);
+            rst_n = 1'b1;
+            model_enable = 1'b1;
+            repeat (500) @(posedge clk);
+            consumed_start = consumed;
+            repeat (MODEL_CYCLES) @(posedge clk);
+
+            $display("%s: %0d flits consumed in %0d cycles, max fill level %0d of %0d",
+                     pause_mode ? "pause quanta" : "xoff", consumed - consumed_start, MODEL_CYCLES, max_fill, MODEL_DEPTH);
+
+            if ((consumed - consumed_start) * 100 < MODEL_CYCLES * 45) begin
+                $error(1, "consumer starved");
+                errors = errors + 1;
+            end
+
+            if (max_fill >= MODEL_DEPTH) begin
+                $error(1, "fifo overflow");
+                errors = errors + 1;
+            end
+        end
+        model_enable = 1'b0;
     end
  
 endmodule
@@ -0,0 +1,20 @@
+#!/usr/bin/bash
+#SBATCH -p fpga
+#SBATCH -t 00:30:00
+#SBATCH -N 1
+#SBATCH --constraint=xilinx_u280_xrt2.14
+#SBATCH --tasks-per-node 2
+#SBATCH --mail-type=ALL
+
+if ! command -v v++ &> /dev/null
+then
+    source env.sh
+fi
+
+srun -n 1 ./scripts/reset.sh
+
+# acl0 and acl1 are double cabled, channel 0 to channel 0 and channel 1 to channel 1
+#https://pc2.github.io/fpgalink-gui/index.html?import=%20--fpgalink%3Dn00%3Aacl0%3Ach0-n00%3Aacl1%3Ach0%20--fpgalink%3Dn00%3Aacl0%3Ach1-n00%3Aacl1%3Ach1
+srun -n 1 changeFPGAlinksXilinx --fpgalink=n00:acl0:ch0-n00:acl1:ch0 --fpgalink=n00:acl0:ch1-n00:acl1:ch1
+
+srun -n 2 -l ./host_aurora_flow_test -m 4 -p aurora_flow_test_bond_hw.xclbin $@
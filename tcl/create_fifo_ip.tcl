@@ -45,6 +45,7 @@ set_property -dict [list CONFIG.TDATA_NUM_BYTES $width \
                          CONFIG.HAS_AEMPTY {1} \
                          CONFIG.HAS_PROG_EMPTY {1} \
                          CONFIG.PROG_EMPTY_THRESH $prog_empty \
+                         CONFIG.HAS_WR_DATA_COUNT {1} \
                          CONFIG.HAS_TKEEP $has_tkeep \
                          CONFIG.HAS_TLAST $has_tlast ] \
              [get_ips axis_data_fifo_$instance]
@@ -1,2 +1,2 @@
-run 1200 ns
+run 2000 ns
 exit [expr int(0x[get_value errors])]
\ No newline at end of file
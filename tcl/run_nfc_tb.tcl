@@ -1,2 +1,2 @@
-run 2000 ns
+run 120 us
 exit [expr int(0x[get_value errors])]